@@ -0,0 +1,505 @@
+/**
+ * Accumulator introduction.
+ *
+ * A linearly recursive function whose recursive calls are all returned
+ * either directly or combined with one other value through `+` or `*`,
+ *
+ *     int f(int n) { if (n == 0) { return 1; } return n * f(n - 1); }
+ *
+ * is rewritten into a loop that carries the partial result in a new local,
+ *
+ *     int f(int n) { acc = 1; while (1) { if (n == 0) { return acc * 1; }
+ *                    acc = acc * n; n = n - 1; } }
+ *
+ * Both operators are associative and commutative in 32-bit arithmetic, so
+ * combining the values outermost call first gives the same result.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "optimise.h"
+#include "shared.h"
+
+typedef enum {
+    RET_BASE,   // return e;             with no recursive call in e
+    RET_TAIL,   // return f(args);
+    RET_LEFT,   // return e op f(args);
+    RET_RIGHT   // return f(args) op e;
+} ReturnKind;
+
+typedef struct Recursion {
+    Node* func;
+    char* op;       // The combining operator, or NULL if there is none yet
+    char* acc;      // Name of the accumulator
+    char** temps;   // Each parameter's temporary, once one is needed
+    char* reason;   // Why the function cannot be rewritten
+} Recursion;
+
+static void rewrite(Node* func);
+static void check_returns(Recursion* r, Node* n, bool in_loop);
+static ReturnKind classify(Recursion* r, Node* e);
+static bool check_tails(Recursion* r, Node* n, bool tail);
+static void normalise(Node* n);
+static void rewrite_returns(Recursion* r, Node* n);
+static Node* update_params(Recursion* r, Node* call);
+static int count_self_calls(Node* n, char* id);
+static bool is_self_call(Node* n, char* id);
+static bool has_arity(Node* func, Node* n);
+static bool has_assign(Node* n);
+static bool is_local_expr(Node* func, Node* n);
+static Node* param(Node* func, int i);
+
+void introduce_accumulators(Node* program)
+{
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        if ((f->element.decl->declaration_kind == DEC_FUNC) &&
+                strcmp(f->token_str, "main") &&
+                (count_self_calls(f->child[1], f->token_str) > 0)) {
+            rewrite(f);
+        }
+    }
+}
+
+/* Private */
+
+static void rewrite(Node* func)
+{
+    Recursion r = { .func = func };
+    Node* body = func->child[1];
+
+    if (has_array_param(func)) {
+        r.reason = "array parameter";
+    } else if (can_complete(body->child[1])) {
+        r.reason = "can reach the end without returning";
+    } else {
+        check_returns(&r, body->child[1], false);
+    }
+
+    if (r.reason == NULL) {
+        // Move statements that follow an if into the branch they continue
+        // from, so each recursive return ends a path through the body
+        normalise(body->child[1]);
+        if (!check_tails(&r, body->child[1], true)) {
+            r.reason = "recursive call is followed by other statements";
+        }
+    }
+
+    if (r.reason != NULL) {
+        remark("not rewriting recursion in '%s': %s", func->token_str,
+                r.reason);
+        return;
+    }
+
+    Node* loop = new_empty_stmt();
+    loop->element.stmt->statement_kind = STMT_WHILE;
+    loop->child[0] = new_num(1);
+
+    if (r.op != NULL) {
+        r.acc = fresh_local(func, func->token_str, "acc");
+        add_local(func, r.acc);
+    }
+    r.temps = calloc(sizeof(char*), num_params(func) + 1);
+    rewrite_returns(&r, body->child[1]);
+    free(r.temps);
+    loop->child[1] = body->child[1];
+
+    if (r.op != NULL) {
+        Node* init = new_assign_stmt(r.acc, new_num(!strcmp(r.op, "*")));
+        init->sibling = loop;
+        body->child[1] = init;
+        remark("rewrote recursion in '%s' into a loop with a '%s' "
+                "accumulator", func->token_str, r.op);
+    } else {
+        body->child[1] = loop;
+        remark("rewrote tail recursion in '%s' into a loop", func->token_str);
+    }
+}
+
+/**
+ * Classify every return, and make sure that no recursive call happens
+ * anywhere other than in a return.
+ */
+static void check_returns(Recursion* r, Node* n, bool in_loop)
+{
+    char* id = r->func->token_str;
+
+    for (Node* s = n; (s != NULL) && (r->reason == NULL); s = s->sibling) {
+        if (s->kind == NODE_CSTMT) {
+            check_returns(r, s->child[1], in_loop);
+            continue;
+        }
+
+        switch (s->element.stmt->statement_kind) {
+            case STMT_IF:
+                if (count_self_calls(s->child[0], id) > 0) {
+                    r->reason = "recursive call in a condition";
+                }
+                check_returns(r, s->child[1], in_loop);
+                check_returns(r, s->child[2], in_loop);
+                break;
+            case STMT_WHILE:
+                if (count_self_calls(s->child[0], id) > 0) {
+                    r->reason = "recursive call in a condition";
+                }
+                check_returns(r, s->child[1], true);
+                break;
+            case STMT_RETURN:
+                if (s->child[0] == NULL) {
+                    r->reason = "return without a value";
+                } else if ((classify(r, s->child[0]) != RET_BASE) &&
+                        in_loop) {
+                    r->reason = "recursive call inside a loop";
+                }
+                break;
+            case STMT_EXPR:
+            default:
+                if (count_self_calls(s->child[0], id) > 0) {
+                    r->reason = "recursive call outside of a return";
+                }
+                break;
+        }
+    }
+}
+
+static ReturnKind classify(Recursion* r, Node* e)
+{
+    char* id = r->func->token_str;
+    int calls = count_self_calls(e, id);
+
+    if (calls == 0) {
+        return RET_BASE;
+    }
+    if (calls > 1) {
+        r->reason = "more than one recursive call in a return";
+        return RET_TAIL;
+    }
+    if (!has_arity(r->func, e)) {
+        r->reason = "recursive call has the wrong number of arguments";
+        return RET_TAIL;
+    }
+    if (is_self_call(e, id)) {
+        return RET_TAIL;
+    }
+
+    if (((e->kind != NODE_ADDIT) && (e->kind != NODE_TERM)) ||
+            (strcmp(e->token_str, "+") && strcmp(e->token_str, "*"))) {
+        r->reason = "result is not combined through + or *";
+        return RET_TAIL;
+    }
+    if ((r->op != NULL) && strcmp(r->op, e->token_str)) {
+        r->reason = "recursive calls are combined through both + and *";
+        return RET_TAIL;
+    }
+    r->op = e->token_str;
+
+    if (is_self_call(e->child[1], id)) {
+        return RET_LEFT;
+    }
+    if (is_self_call(e->child[0], id)) {
+        // The other operand moves ahead of the call, which is only safe if
+        // nothing the call does could change it
+        if (!is_local_expr(r->func, e->child[1]) ||
+                has_assign(e->child[0]->child[0])) {
+            r->reason = "operand after the call may depend on it";
+        }
+        return RET_RIGHT;
+    }
+
+    r->reason = "recursive call is nested in the operand";
+    return RET_TAIL;
+}
+
+/**
+ * True if each recursive return is the last statement on its path, so that
+ * falling off the end of it goes back around the loop.
+ */
+static bool check_tails(Recursion* r, Node* n, bool tail)
+{
+    char* id = r->func->token_str;
+    for (; n != NULL; n = n->sibling) {
+        bool last = tail && (n->sibling == NULL);
+
+        if (n->kind == NODE_CSTMT) {
+            if (!check_tails(r, n->child[1], last)) {
+                return false;
+            }
+            continue;
+        }
+
+        switch (n->element.stmt->statement_kind) {
+            case STMT_IF:
+                if (!check_tails(r, n->child[1], last) ||
+                        !check_tails(r, n->child[2], last)) {
+                    return false;
+                }
+                break;
+            case STMT_RETURN:
+                if (!last && (count_self_calls(n->child[0], id) > 0)) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * `if (c) { A } B` becomes `if (c) { A } else { B }` when A cannot complete,
+ * and likewise for a then branch that can and an else that cannot.
+ */
+static void normalise(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            normalise(n->child[1]);
+            continue;
+        }
+        if (n->element.stmt->statement_kind != STMT_IF) {
+            continue;
+        }
+
+        Node* rest = n->sibling;
+        Node** branch = NULL;
+        if (rest != NULL) {
+            if (!can_complete(n->child[1])) {
+                branch = &n->child[2];
+            } else if ((n->child[2] != NULL) && !can_complete(n->child[2])) {
+                branch = &n->child[1];
+            }
+        }
+
+        if (branch != NULL) {
+            while (*branch != NULL) {
+                branch = &(*branch)->sibling;
+            }
+            *branch = rest;
+            n->sibling = NULL;
+        }
+
+        normalise(n->child[1]);
+        normalise(n->child[2]);
+    }
+}
+
+/**
+ * Fold base returns into the accumulator, and replace recursive returns with
+ * an update of the accumulator and parameters.
+ */
+static void rewrite_returns(Recursion* r, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            rewrite_returns(r, n->child[1]);
+            continue;
+        }
+
+        switch (n->element.stmt->statement_kind) {
+            case STMT_IF:
+                rewrite_returns(r, n->child[1]);
+                rewrite_returns(r, n->child[2]);
+                break;
+            case STMT_WHILE:
+                rewrite_returns(r, n->child[1]);
+                break;
+            case STMT_RETURN: {
+                Node* e = n->child[0];
+                Node* update = NULL;
+
+                switch (classify(r, e)) {
+                    case RET_BASE:
+                        if (r->op != NULL) {
+                            n->child[0] = new_binop(r->op, new_var(r->acc), e);
+                        }
+                        continue;
+                    case RET_TAIL:
+                        update = update_params(r, e);
+                        break;
+                    case RET_LEFT:
+                        update = new_assign_stmt(r->acc,
+                                new_binop(r->op, new_var(r->acc), e->child[0]));
+                        update->sibling = update_params(r, e->child[1]);
+                        break;
+                    case RET_RIGHT:
+                        update = new_assign_stmt(r->acc,
+                                new_binop(r->op, new_var(r->acc), e->child[1]));
+                        update->sibling = update_params(r, e->child[0]);
+                        break;
+                }
+
+                if (update == NULL) {
+                    // Called with its own parameters: loops as it is
+                    update = new_empty_stmt();
+                }
+                Node* sibling = n->sibling;
+                *n = *update;
+                Node* tail = n;
+                while (tail->sibling != NULL) {
+                    tail = tail->sibling;
+                }
+                tail->sibling = sibling;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Assign the arguments of a recursive call to the parameters, last to first
+ * as a call would evaluate them. An argument goes through a temporary if an
+ * argument evaluated after it still needs the parameter's old value.
+ */
+static Node* update_params(Recursion* r, Node* call)
+{
+    int num = num_params(r->func);
+    Node** args = calloc(sizeof(Node*), num + 1);
+    bool any_assign = false;
+
+    int i = 0;
+    for (Node* a = call->child[0]; a != NULL; a = a->sibling) {
+        args[i++] = a;
+        any_assign |= has_assign(a);
+    }
+    for (i = 0; i < num; ++i) {
+        args[i]->sibling = NULL;
+    }
+
+    Node* head = NULL;
+    Node** link = &head;
+    Node* moves = NULL;
+    Node** moves_link = &moves;
+
+    for (i = num - 1; i >= 0; --i) {
+        char* p = param(r->func, i)->token_str;
+        if ((args[i]->kind == NODE_VAR) && (args[i]->child[0] == NULL) &&
+                !strcmp(args[i]->token_str, p)) {
+            continue;
+        }
+
+        bool needs_temp = any_assign;
+        for (int j = 0; j < i; ++j) {
+            needs_temp |= is_referenced(args[j], p);
+        }
+
+        if (needs_temp) {
+            if (r->temps[i] == NULL) {
+                r->temps[i] = fresh_local(r->func, p, "next");
+                add_local(r->func, r->temps[i]);
+            }
+            *link = new_assign_stmt(r->temps[i], args[i]);
+            *moves_link = new_assign_stmt(p, new_var(r->temps[i]));
+            moves_link = &(*moves_link)->sibling;
+        } else {
+            *link = new_assign_stmt(p, args[i]);
+        }
+        link = &(*link)->sibling;
+    }
+    *link = moves;
+
+    free(args);
+    return head;
+}
+
+static int count_self_calls(Node* n, char* id)
+{
+    int calls = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE) &&
+                !strcmp(n->token_str, id)) {
+            calls += 1;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            calls += count_self_calls(n->child[i], id);
+        }
+    }
+    return calls;
+}
+
+static bool is_self_call(Node* n, char* id)
+{
+    return (n != NULL) && (n->kind == NODE_CALL) &&
+            (n->element.call->call_kind != CALL_INLINE) &&
+            !strcmp(n->token_str, id);
+}
+
+/**
+ * True if every recursive call in the expression passes one argument per
+ * parameter.
+ */
+static bool has_arity(Node* func, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (is_self_call(n, func->token_str)) {
+            int args = 0;
+            for (Node* a = n->child[0]; a != NULL; a = a->sibling) {
+                args += 1;
+            }
+            if (args != num_params(func)) {
+                return false;
+            }
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (!has_arity(func, n->child[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool has_assign(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_EXPR) {
+            return true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (has_assign(n->child[i])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * True if the expression only reads the function's own variables, and has
+ * no side effects.
+ */
+static bool is_local_expr(Node* func, Node* n)
+{
+    if (n == NULL) {
+        return true;
+    }
+    switch (n->kind) {
+        case NODE_FACTOR:
+            return true;
+        case NODE_VAR:
+            return declares(func, n->token_str) &&
+                    is_local_expr(func, n->child[0]);
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return is_local_expr(func, n->child[0]) &&
+                    is_local_expr(func, n->child[1]);
+        default:
+            return false;
+    }
+}
+
+static Node* param(Node* func, int i)
+{
+    Node* p = func->child[0];
+    while (i-- > 0) {
+        p = p->sibling;
+    }
+    return p;
+}
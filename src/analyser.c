@@ -74,10 +74,6 @@ void analyse_addit(Node* n, Scope* s)
 
     analyse_term(n->child[0], s);
     analyse_term(n->child[1], s);
-
-    while (n->sibling != NULL) {
-        analyse_addit(n->sibling, s);
-    }
 }
 
 /**
@@ -1,6 +1,11 @@
 #include "ast.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+static bool has_decl(Node* n, char* id);
+static void hoist_nested(Node* func, Node* n);
 
 /**
  * Create new node conditional on the node's type.
@@ -74,3 +79,545 @@ Node* new_node(NodeKind type)
 
     return node;
 }
+
+/**
+ * Create an empty expression statement, `;`.
+ */
+Node* new_empty_stmt(void)
+{
+    Node* node = new_node(NODE_STMT);
+    node->element.stmt->statement_kind = STMT_EXPR;
+    node->child[0] = NULL;
+    return node;
+}
+
+/**
+ * True if the node is an expression statement with no expression.
+ */
+bool is_empty_stmt(Node* n)
+{
+    return (n->kind == NODE_STMT) &&
+            (n->element.stmt->statement_kind == STMT_EXPR) &&
+            (n->child[0] == NULL);
+}
+
+/**
+ * True if evaluating the expression may do anything other than produce a
+ * value, i.e. it contains a call or an assignment.
+ */
+bool has_side_effects(Node* n)
+{
+    if (n == NULL) {
+        return false;
+    }
+
+    switch (n->kind) {
+        case NODE_CALL:
+        case NODE_EXPR:
+            return true;
+        case NODE_VAR:
+            return has_side_effects(n->child[0]);
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return has_side_effects(n->child[0]) ||
+                    has_side_effects(n->child[1]);
+        default:
+            return false;
+    }
+}
+
+static void* copy_element(void* element, size_t size)
+{
+    if (element == NULL) {
+        return NULL;
+    }
+    void* copy = malloc(size);
+    memcpy(copy, element, size);
+    return copy;
+}
+
+/**
+ * Deep copy of a node along with its children and siblings. Identifier and
+ * operator strings are shared with the original.
+ */
+Node* copy_tree(Node* n)
+{
+    if (n == NULL) {
+        return NULL;
+    }
+
+    Node* copy = calloc(sizeof(Node), 1);
+    *copy = *n;
+
+    switch (n->kind) {
+        case NODE_DEC:
+            copy->element.decl = copy_element(n->element.decl,
+                    sizeof(Declaration));
+            copy->element.decl->var = copy_element(n->element.decl->var,
+                    sizeof(Variable));
+            break;
+        case NODE_CSTMT:
+            copy->element.cstmt = copy_element(n->element.cstmt,
+                    sizeof(CompoundStatement));
+            break;
+        case NODE_VAR:
+            copy->element.var = copy_element(n->element.var, sizeof(Variable));
+            break;
+        case NODE_STMT:
+            copy->element.stmt = copy_element(n->element.stmt,
+                    sizeof(Statement));
+            break;
+        case NODE_PARAMS:
+            copy->element.params = copy_element(n->element.params,
+                    sizeof(Parameter));
+            break;
+        case NODE_EXPR:
+            copy->element.expr = copy_element(n->element.expr,
+                    sizeof(Expression));
+            break;
+        case NODE_SEXPR:
+            copy->element.sexpr = copy_element(n->element.sexpr,
+                    sizeof(SimpleExpression));
+            break;
+        case NODE_ADDIT:
+            copy->element.addit = copy_element(n->element.addit,
+                    sizeof(AdditiveExpression));
+            break;
+        case NODE_TERM:
+            copy->element.term = copy_element(n->element.term, sizeof(Term));
+            break;
+        case NODE_FACTOR:
+            copy->element.factor = copy_element(n->element.factor,
+                    sizeof(Factor));
+            break;
+        case NODE_CALL:
+            copy->element.call = copy_element(n->element.call, sizeof(Call));
+            break;
+        case NODE_ARGS:
+            copy->element.args = copy_element(n->element.args,
+                    sizeof(Arguments));
+            break;
+        case NODE_NONE:
+        default:
+            break;
+    }
+
+    for (int i = 0; i < MAX_CHILDREN; ++i) {
+        copy->child[i] = copy_tree(n->child[i]);
+    }
+    copy->sibling = copy_tree(n->sibling);
+
+    return copy;
+}
+
+/**
+ * True if two expressions are written identically. Calls are never the same,
+ * as each may have its own effects.
+ */
+bool same_tree(Node* a, Node* b)
+{
+    if ((a == NULL) || (b == NULL)) {
+        return a == b;
+    }
+    if ((a->kind != b->kind) || (a->kind == NODE_CALL)) {
+        return false;
+    }
+    if ((a->token_str == NULL) || (b->token_str == NULL)) {
+        if (a->token_str != b->token_str) {
+            return false;
+        }
+    } else if (strcmp(a->token_str, b->token_str)) {
+        return false;
+    }
+    if ((a->kind == NODE_VAR) &&
+            ((a->element.var->variable_kind !=
+              b->element.var->variable_kind) ||
+             (a->element.var->offset != b->element.var->offset))) {
+        return false;
+    }
+    for (int i = 0; i < MAX_CHILDREN; ++i) {
+        if (!same_tree(a->child[i], b->child[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The declaration of the named function, or NULL for the builtins.
+ */
+Node* find_function(Node* program, char* id)
+{
+    for (Node* n = program; n != NULL; n = n->sibling) {
+        if ((n->element.decl->declaration_kind == DEC_FUNC) &&
+                !strcmp(n->token_str, id)) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+int num_params(Node* func)
+{
+    int params = 0;
+    for (Node* p = func->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind != PARAM_VOID) {
+            params += 1;
+        }
+    }
+    return params;
+}
+
+bool has_array_param(Node* func)
+{
+    for (Node* p = func->child[0]; p != NULL; p = p->sibling) {
+        if ((p->element.params->parameter_kind != PARAM_VOID) &&
+                (p->element.params->variable_kind == VAR_ARRAY)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int num_stack_params(Node* func)
+{
+    int params = num_params(func);
+    return params > NUM_ARG_REGS ? params - NUM_ARG_REGS : 0;
+}
+
+/**
+ * True if the statements or expressions call anything other than the
+ * builtins, which leave the frame and argument registers alone. The bodies
+ * of inlined calls are searched too.
+ */
+bool has_calls(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE) &&
+                strcmp(n->token_str, "input") &&
+                strcmp(n->token_str, "output")) {
+            return true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (has_calls(n->child[i])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * True if the identifier is read or written anywhere in the statements or
+ * expressions. Declarations don't count.
+ */
+bool is_referenced(Node* n, char* id)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && !strcmp(n->token_str, id)) {
+            return true;
+        }
+
+        if (n->kind == NODE_CSTMT) {
+            if (is_referenced(n->child[1], id)) {
+                return true;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (is_referenced(n->child[i], id)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Size of a tree, roughly one per instruction sequence it generates.
+ */
+int count_nodes(Node* n)
+{
+    int nodes = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind != NODE_NONE) && (n->kind != NODE_DEC)) {
+            nodes += 1;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            nodes += count_nodes(n->child[i]);
+        }
+    }
+    return nodes;
+}
+
+/**
+ * Assignments to a scalar, anywhere under `n`.
+ */
+int count_writes(Node* n, char* id)
+{
+    int writes = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_EXPR) && (n->child[0]->child[0] == NULL) &&
+                !is_deref(n->child[0]) &&
+                !strcmp(n->child[0]->token_str, id)) {
+            writes += 1;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            writes += count_writes(n->child[i], id);
+        }
+    }
+    return writes;
+}
+
+/**
+ * Apply an additive, multiplicative or relational operator to two values.
+ * Fails where the instruction would trap, on overflow of + or - and on
+ * division by zero, leaving those to run time. A product wraps, as mul does.
+ */
+bool evaluate_op(char* op, int lhs, int rhs, int* value)
+{
+    long long result = 0;
+
+    if (!strcmp(op, "+")) {
+        result = (long long) lhs + rhs;
+    } else if (!strcmp(op, "-")) {
+        result = (long long) lhs - rhs;
+    } else if (!strcmp(op, "*")) {
+        result = (int) ((unsigned) lhs * (unsigned) rhs);
+    } else if (!strcmp(op, "/")) {
+        if (rhs == 0) {
+            return false;
+        }
+        result = (long long) lhs / rhs;
+    } else if (!strcmp(op, "<")) {
+        result = lhs < rhs;
+    } else if (!strcmp(op, "<=")) {
+        result = lhs <= rhs;
+    } else if (!strcmp(op, ">")) {
+        result = lhs > rhs;
+    } else if (!strcmp(op, ">=")) {
+        result = lhs >= rhs;
+    } else if (!strcmp(op, "==")) {
+        result = lhs == rhs;
+    } else if (!strcmp(op, "!=")) {
+        result = lhs != rhs;
+    } else {
+        return false;
+    }
+
+    if ((result < INT_MIN) || (result > INT_MAX)) {
+        return false;
+    }
+    *value = (int) result;
+    return true;
+}
+
+/**
+ * A reference to a scalar, `id`.
+ */
+Node* new_var(char* id)
+{
+    Node* var = new_node(NODE_VAR);
+    var->element.var->variable_kind = VAR_SINGLE;
+    var->token_str = id;
+    var->child[0] = NULL;
+    return var;
+}
+
+/**
+ * An integer literal. The parser only makes non-negative ones, but cgen loads
+ * any value.
+ */
+Node* new_num(int value)
+{
+    Node* num = new_node(NODE_FACTOR);
+    num->element.factor->factor_kind = FAC_NUM;
+    num->token_str = malloc(MAX_TOKEN_SIZE + 1);
+    snprintf(num->token_str, MAX_TOKEN_SIZE + 1, "%d", value);
+    return num;
+}
+
+/**
+ * `lhs op rhs` for an additive or multiplicative operator.
+ */
+Node* new_binop(char* op, Node* lhs, Node* rhs)
+{
+    Node* n = NULL;
+    if (!strcmp(op, "+") || !strcmp(op, "-")) {
+        n = new_node(NODE_ADDIT);
+        n->element.addit->additive_kind = ADDIT_ADDOP;
+    } else {
+        n = new_node(NODE_TERM);
+        n->element.term->term_kind = TERM_MULOP;
+    }
+    n->token_str = op;
+    n->child[0] = lhs;
+    n->child[1] = rhs;
+    return n;
+}
+
+/**
+ * The statement `id = rhs;`.
+ */
+Node* new_assign_stmt(char* id, Node* rhs)
+{
+    Node* assign = new_node(NODE_EXPR);
+    assign->element.expr->expression_kind = EXPR_VAR;
+    assign->token_str = "=";
+    assign->child[0] = new_var(id);
+    assign->child[1] = rhs;
+
+    Node* stmt = new_empty_stmt();
+    stmt->child[0] = assign;
+    return stmt;
+}
+
+/**
+ * The address of an array element, `&array[index]`.
+ */
+Node* new_address(char* array, Node* index)
+{
+    Node* var = new_var(array);
+    var->element.var->variable_kind = VAR_ADDRESS;
+    var->child[0] = index;
+    return var;
+}
+
+/**
+ * The word `offset` bytes past the address held in the scalar `id`.
+ */
+Node* new_deref(char* id, int offset)
+{
+    Node* var = new_var(id);
+    var->element.var->variable_kind = VAR_DEREF;
+    var->element.var->offset = offset;
+    return var;
+}
+
+/**
+ * True for a read of, or store to, the word a scalar points at. The scalar
+ * itself is only read.
+ */
+bool is_deref(Node* var)
+{
+    return (var->kind == NODE_VAR) &&
+            (var->element.var->variable_kind == VAR_DEREF);
+}
+
+/**
+ * Put a statement in front of another in whichever list holds it. The
+ * existing node is reused for the new statement, so the old one moves.
+ */
+void insert_before(Node* stmt, Node* new_stmt)
+{
+    Node* moved = calloc(sizeof(Node), 1);
+    *moved = *stmt;
+    *stmt = *new_stmt;
+    stmt->sibling = moved;
+}
+
+/**
+ * Declare a new scalar local at the top of a function's body.
+ */
+void add_local(Node* func, char* id)
+{
+    Node* dec = new_node(NODE_DEC);
+    dec->element.decl->declaration_kind = DEC_VAR;
+    dec->element.decl->var->variable_kind = VAR_SINGLE;
+    dec->element.decl->var->type = TYPE_INT;
+    dec->token_str = id;
+    append_decl(func, dec);
+}
+
+/**
+ * A name for a new local of a function, `<base>.<tag><n>` for the lowest n
+ * that it doesn't already declare. Identifiers are letters only, so a name
+ * with a '.' cannot clash with any in the source. The caller declares it.
+ */
+char* fresh_local(Node* func, char* base, char* tag)
+{
+    size_t len = strlen(base) + strlen(tag) + 16;
+    char* name = malloc(len);
+    int n = 0;
+    do {
+        snprintf(name, len, "%s.%s%d", base, tag, n++);
+    } while (declares(func, name));
+    return name;
+}
+
+/**
+ * Add an existing declaration to the top of a function's body.
+ */
+void append_decl(Node* func, Node* dec)
+{
+    Node** tail = &func->child[1]->child[0];
+    while (*tail != NULL) {
+        tail = &(*tail)->sibling;
+    }
+    dec->sibling = NULL;
+    *tail = dec;
+}
+
+/**
+ * True if the function has a parameter or local of that name.
+ */
+bool declares(Node* func, char* id)
+{
+    for (Node* p = func->child[0]; p != NULL; p = p->sibling) {
+        if ((p->element.params->parameter_kind != PARAM_VOID) &&
+                !strcmp(p->token_str, id)) {
+            return true;
+        }
+    }
+    return has_decl(func->child[1], id);
+}
+
+static bool has_decl(Node* n, char* id)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_DEC) {
+            if (!strcmp(n->token_str, id)) {
+                return true;
+            }
+            continue;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (has_decl(n->child[i], id)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Move the declarations of nested blocks up to the function's own. The
+ * analyser gives each function a single scope, so the names are distinct,
+ * and every local is then allocated once, on entry.
+ */
+void hoist_block_decls(Node* func)
+{
+    hoist_nested(func, func->child[1]->child[1]);
+}
+
+static void hoist_nested(Node* func, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_DEC) {
+            continue;
+        }
+        if (n->kind == NODE_CSTMT) {
+            while (n->child[0] != NULL) {
+                Node* dec = n->child[0];
+                n->child[0] = dec->sibling;
+                append_decl(func, dec);
+            }
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            hoist_nested(func, n->child[i]);
+        }
+    }
+}
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #include "shared.h"
 
 #include "ast_nodes.h"
@@ -12,6 +14,9 @@
 
 #define MAX_CHILDREN 3
 
+// Arguments passed in $a0-$a3; any more are passed on the stack
+#define NUM_ARG_REGS 4
+
 /* Data Structures */
 typedef enum NodeKind {
     NODE_NONE,
@@ -51,7 +56,36 @@ struct Node {
     Node* child[MAX_CHILDREN];
     Node* sibling;
     char* token_str;
+    int site;       // Profile counter of the block this node starts, or 0
 };
 
 /* Function prototypes */
 Node* new_node(NodeKind kind);
+Node* new_empty_stmt(void);
+bool is_empty_stmt(Node* n);
+bool has_side_effects(Node* n);
+Node* copy_tree(Node* n);
+bool same_tree(Node* a, Node* b);
+Node* find_function(Node* program, char* id);
+int num_params(Node* func);
+bool has_array_param(Node* func);
+int num_stack_params(Node* func);
+bool has_calls(Node* n);
+bool is_referenced(Node* n, char* id);
+bool declares(Node* func, char* id);
+int count_nodes(Node* n);
+int count_writes(Node* n, char* id);
+bool evaluate_op(char* op, int lhs, int rhs, int* value);
+
+Node* new_var(char* id);
+Node* new_num(int value);
+Node* new_binop(char* op, Node* lhs, Node* rhs);
+Node* new_assign_stmt(char* id, Node* rhs);
+Node* new_address(char* array, Node* index);
+Node* new_deref(char* id, int offset);
+bool is_deref(Node* var);
+void insert_before(Node* stmt, Node* new_stmt);
+void add_local(Node* func, char* id);
+char* fresh_local(Node* func, char* base, char* tag);
+void append_decl(Node* func, Node* dec);
+void hoist_block_decls(Node* func);
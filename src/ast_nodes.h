@@ -16,7 +16,9 @@ enum CompoundStatementKind {
 enum VariableKind { 
     VAR_NONE,
     VAR_SINGLE,
-    VAR_ARRAY
+    VAR_ARRAY,
+    VAR_ADDRESS, // Address of an array element, made by optimisation
+    VAR_DEREF    // Word at the address held in a scalar
 };
 
 enum StatementKind {
@@ -68,7 +70,9 @@ enum FactorKind {
 enum CallKind { 
     CALL_NONE,
     CALL_EMPTY,
-    CALL_ARGS
+    CALL_ARGS,
+    CALL_INLINE,
+    CALL_TAIL
 };
 
 enum ArgumentKind { 
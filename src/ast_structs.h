@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "ast_nodes.h"
 #include "types.h"
 
@@ -11,6 +13,7 @@ typedef struct Variable {
     enum VariableKind variable_kind;
     enum Type type;
     int arr_len;
+    int offset;  // Bytes past the address held, for a VAR_DEREF
 } Variable;
 
 typedef struct Declaration {
@@ -21,6 +24,9 @@ typedef struct Declaration {
 
 typedef struct Statement {
     enum StatementKind statement_kind;
+    bool enters;      // A while loop whose condition holds on entry
+    bool else_first;  // An if whose else arm is laid out to fall through
+    bool out_of_line; // An if whose other arm is placed after its function
 } Statement;
 
 typedef struct Parameter {
@@ -0,0 +1,511 @@
+/**
+ * Control flow graph and liveness analysis over a single function.
+ *
+ * Blocks hold pointers into the AST rather than copies, so passes can use the
+ * graph to decide what to change and then edit the statements in place.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "shared.h"
+
+static Block* new_block(Cfg* cfg);
+static void add_stmt(Block* b, Node* n);
+static void add_edge(Block* from, Block* to);
+static void add_var(Cfg* cfg, char* id);
+static void collect_vars(Cfg* cfg, Node* n);
+static Block* build_stmts(Cfg* cfg, Node* n, Block* cur);
+static void mark_reachable(Block* b);
+static void use_all(Cfg* cfg, Node* n, bool* live);
+
+/**
+ * Build the graph for a function declaration.
+ */
+Cfg* build_cfg(Node* func)
+{
+    assert((func->kind == NODE_DEC) &&
+            (func->element.decl->declaration_kind == DEC_FUNC));
+
+    Cfg* cfg = calloc(sizeof(Cfg), 1);
+    cfg->func = func;
+
+    Node* p = func->child[0];
+    while (p != NULL) {
+        if ((p->element.params->parameter_kind != PARAM_VOID) &&
+                (p->element.params->variable_kind == VAR_SINGLE)) {
+            add_var(cfg, p->token_str);
+        }
+        p = p->sibling;
+    }
+    collect_vars(cfg, func->child[1]);
+
+    cfg->entry = new_block(cfg);
+    cfg->exit = new_block(cfg);
+
+    Block* last = build_stmts(cfg, func->child[1], cfg->entry);
+    if (last != NULL) {
+        add_edge(last, cfg->exit);
+    }
+
+    mark_reachable(cfg->entry);
+    return cfg;
+}
+
+void free_cfg(Cfg* cfg)
+{
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        free(cfg->blocks[i]->stmts);
+        free(cfg->blocks[i]->live_in);
+        free(cfg->blocks[i]->live_out);
+        free(cfg->blocks[i]->dom);
+        free(cfg->blocks[i]);
+    }
+    free(cfg->blocks);
+    free(cfg->vars);
+    free(cfg);
+}
+
+/**
+ * Index of a tracked variable, or -1 for globals and arrays.
+ */
+int find_var(Cfg* cfg, char* id)
+{
+    for (int i = 0; i < cfg->num_vars; ++i) {
+        if (!strcmp(cfg->vars[i], id)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Move `live` backwards over the evaluation of an expression, visiting its
+ * parts in the reverse of the order cgen evaluates them.
+ */
+void transfer_expr(Cfg* cfg, Node* n, bool* live)
+{
+    if (n == NULL) {
+        return;
+    }
+
+    int v = -1;
+    switch (n->kind) {
+        case NODE_VAR:
+            if (n->child[0] != NULL) {
+                transfer_expr(cfg, n->child[0], live);
+            } else if ((v = find_var(cfg, n->token_str)) >= 0) {
+                live[v] = true;
+            }
+            break;
+        case NODE_EXPR:
+            // rhs, then the index of an array target, then the store
+            if (n->child[0]->child[0] != NULL) {
+                transfer_expr(cfg, n->child[0]->child[0], live);
+            } else if ((v = find_var(cfg, n->child[0]->token_str)) >= 0) {
+                // A store through a pointer reads the pointer
+                live[v] = is_deref(n->child[0]);
+            }
+            transfer_expr(cfg, n->child[1], live);
+            break;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            transfer_expr(cfg, n->child[1], live);
+            transfer_expr(cfg, n->child[0], live);
+            break;
+        case NODE_CALL:
+            if (n->element.call->call_kind == CALL_INLINE) {
+                // Control flow within an inlined body isn't modelled, so
+                // treat everything it mentions as read and nothing as killed
+                use_all(cfg, n->child[1], live);
+            }
+            for (Node* arg = n->child[0]; arg != NULL; arg = arg->sibling) {
+                transfer_expr(cfg, arg, live);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Iterative forwards dataflow: a block is dominated by itself and by every
+ * block that dominates all of its reachable predecessors.
+ */
+void compute_dominators(Cfg* cfg)
+{
+    int n = cfg->num_blocks;
+    for (int i = 0; i < n; ++i) {
+        Block* b = cfg->blocks[i];
+        free(b->dom);
+        b->dom = malloc(sizeof(bool) * n);
+        for (int j = 0; j < n; ++j) {
+            b->dom[j] = (b != cfg->entry) || (j == b->id);
+        }
+    }
+
+    bool* dom = malloc(sizeof(bool) * n);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < n; ++i) {
+            Block* b = cfg->blocks[i];
+            if ((b == cfg->entry) || !b->reachable) {
+                continue;
+            }
+
+            for (int j = 0; j < n; ++j) {
+                dom[j] = true;
+            }
+            for (int p = 0; p < n; ++p) {
+                Block* pred = cfg->blocks[p];
+                if (!pred->reachable) {
+                    continue;
+                }
+                for (int s = 0; s < pred->num_succ; ++s) {
+                    if (pred->succ[s] != b) {
+                        continue;
+                    }
+                    for (int j = 0; j < n; ++j) {
+                        dom[j] &= pred->dom[j];
+                    }
+                }
+            }
+            dom[b->id] = true;
+
+            if (memcmp(dom, b->dom, sizeof(bool) * n)) {
+                memcpy(b->dom, dom, sizeof(bool) * n);
+                changed = true;
+            }
+        }
+    }
+    free(dom);
+}
+
+/**
+ * The blocks of the natural loop of `header`: those that reach a back edge
+ * to it, an edge from a block it dominates, without passing through it.
+ * Returns membership by block id, or NULL if there is no back edge.
+ * Requires compute_dominators.
+ */
+bool* natural_loop(Cfg* cfg, Block* header)
+{
+    int n = cfg->num_blocks;
+    bool* loop = calloc(sizeof(bool), n);
+    Block** work = malloc(sizeof(Block*) * n);
+    int num_work = 0;
+    bool found = false;
+
+    loop[header->id] = true;
+    for (int i = 0; i < n; ++i) {
+        Block* b = cfg->blocks[i];
+        for (int s = 0; s < b->num_succ; ++s) {
+            if (b->reachable && (b->succ[s] == header) && b->dom[header->id]) {
+                found = true;
+                if (!loop[b->id]) {
+                    loop[b->id] = true;
+                    work[num_work++] = b;
+                }
+            }
+        }
+    }
+
+    while (num_work > 0) {
+        Block* b = work[--num_work];
+        for (int p = 0; p < n; ++p) {
+            Block* pred = cfg->blocks[p];
+            for (int s = 0; s < pred->num_succ; ++s) {
+                if (pred->reachable && (pred->succ[s] == b) &&
+                        !loop[pred->id]) {
+                    loop[pred->id] = true;
+                    work[num_work++] = pred;
+                }
+            }
+        }
+    }
+
+    free(work);
+    if (!found) {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+/**
+ * Iterative backwards dataflow over the tracked variables.
+ */
+void compute_liveness(Cfg* cfg)
+{
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        free(b->live_in);
+        free(b->live_out);
+        b->live_in = calloc(sizeof(bool), cfg->num_vars + 1);
+        b->live_out = calloc(sizeof(bool), cfg->num_vars + 1);
+    }
+
+    bool* live = calloc(sizeof(bool), cfg->num_vars + 1);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = cfg->num_blocks - 1; i >= 0; --i) {
+            Block* b = cfg->blocks[i];
+
+            for (int s = 0; s < b->num_succ; ++s) {
+                for (int v = 0; v < cfg->num_vars; ++v) {
+                    b->live_out[v] |= b->succ[s]->live_in[v];
+                }
+            }
+
+            memcpy(live, b->live_out, sizeof(bool) * cfg->num_vars);
+            if (b->branch != NULL) {
+                transfer_expr(cfg, b->branch->child[0], live);
+            }
+            for (int s = b->num_stmts - 1; s >= 0; --s) {
+                transfer_expr(cfg, b->stmts[s]->child[0], live);
+            }
+
+            if (memcmp(live, b->live_in, sizeof(bool) * cfg->num_vars)) {
+                memcpy(b->live_in, live, sizeof(bool) * cfg->num_vars);
+                changed = true;
+            }
+        }
+    }
+    free(live);
+}
+
+/**
+ * True if the condition is a literal, which is stored in `value`.
+ */
+bool is_const_cond(Node* n, int* value)
+{
+    if ((n != NULL) && (n->kind == NODE_FACTOR)) {
+        *value = atoi(n->token_str);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * True if control can run off the end of the statement list, rather than
+ * always leaving through a return or looping forever.
+ */
+bool can_complete(Node* n)
+{
+    int value = 0;
+    while (n != NULL) {
+        if (n->kind == NODE_CSTMT) {
+            if (!can_complete(n->child[1])) {
+                return false;
+            }
+        } else if (n->kind == NODE_STMT) {
+            switch (n->element.stmt->statement_kind) {
+                case STMT_RETURN:
+                    return false;
+                case STMT_IF:
+                    if (is_const_cond(n->child[0], &value)) {
+                        if (!can_complete(value ? n->child[1] : n->child[2])) {
+                            return false;
+                        }
+                    } else if (!can_complete(n->child[1]) &&
+                            (n->child[2] != NULL) &&
+                            !can_complete(n->child[2])) {
+                        return false;
+                    }
+                    break;
+                case STMT_WHILE:
+                    if (is_const_cond(n->child[0], &value) && value != 0) {
+                        return false;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        n = n->sibling;
+    }
+    return true;
+}
+
+/* Private */
+
+static Block* new_block(Cfg* cfg)
+{
+    if (cfg->num_blocks == cfg->cap_blocks) {
+        cfg->cap_blocks = cfg->cap_blocks ? cfg->cap_blocks * 2 : 16;
+        cfg->blocks = realloc(cfg->blocks, sizeof(Block*) * cfg->cap_blocks);
+    }
+
+    Block* b = calloc(sizeof(Block), 1);
+    b->id = cfg->num_blocks;
+    cfg->blocks[cfg->num_blocks++] = b;
+    return b;
+}
+
+static void add_stmt(Block* b, Node* n)
+{
+    if (b->num_stmts == b->cap_stmts) {
+        b->cap_stmts = b->cap_stmts ? b->cap_stmts * 2 : 8;
+        b->stmts = realloc(b->stmts, sizeof(Node*) * b->cap_stmts);
+    }
+    b->stmts[b->num_stmts++] = n;
+}
+
+static void add_edge(Block* from, Block* to)
+{
+    assert(from->num_succ < 2);
+    from->succ[from->num_succ++] = to;
+    to->num_preds += 1;
+}
+
+static void add_var(Cfg* cfg, char* id)
+{
+    if (cfg->num_vars == cfg->cap_vars) {
+        cfg->cap_vars = cfg->cap_vars ? cfg->cap_vars * 2 : 16;
+        cfg->vars = realloc(cfg->vars, sizeof(char*) * cfg->cap_vars);
+    }
+    cfg->vars[cfg->num_vars++] = id;
+}
+
+/**
+ * Every scalar declared anywhere in the body. The analyser keeps a single
+ * scope per function, so names are unique across nested blocks.
+ */
+static void collect_vars(Cfg* cfg, Node* n)
+{
+    while (n != NULL) {
+        if (n->kind == NODE_CSTMT) {
+            for (Node* d = n->child[0]; d != NULL; d = d->sibling) {
+                if (d->element.decl->var->variable_kind == VAR_SINGLE) {
+                    add_var(cfg, d->token_str);
+                }
+            }
+            collect_vars(cfg, n->child[1]);
+        } else if (n->kind == NODE_STMT) {
+            switch (n->element.stmt->statement_kind) {
+                case STMT_IF:
+                    collect_vars(cfg, n->child[1]);
+                    collect_vars(cfg, n->child[2]);
+                    break;
+                case STMT_WHILE:
+                    collect_vars(cfg, n->child[1]);
+                    break;
+                default:
+                    break;
+            }
+        }
+        n = n->sibling;
+    }
+}
+
+/**
+ * Append a statement list to the graph starting in `cur`. Returns the block
+ * that control falls out of, or NULL if it cannot fall out at all.
+ */
+static Block* build_stmts(Cfg* cfg, Node* n, Block* cur)
+{
+    int value = 0;
+    while (n != NULL) {
+        if (cur == NULL) {
+            // Follows a return: starts a block with no predecessors
+            cur = new_block(cfg);
+        }
+
+        if (n->kind == NODE_CSTMT) {
+            cur = build_stmts(cfg, n->child[1], cur);
+        } else if (n->kind == NODE_STMT) {
+            Block* then_b = NULL;
+            Block* else_b = NULL;
+            Block* join = NULL;
+
+            switch (n->element.stmt->statement_kind) {
+                case STMT_EXPR:
+                    add_stmt(cur, n);
+                    break;
+                case STMT_IF:
+                    cur->branch = n;
+
+                    then_b = new_block(cfg);
+                    else_b = new_block(cfg);
+                    if (!is_const_cond(n->child[0], &value) || value != 0) {
+                        add_edge(cur, then_b);
+                    }
+                    if (!is_const_cond(n->child[0], &value) || value == 0) {
+                        add_edge(cur, else_b);
+                    }
+
+                    join = new_block(cfg);
+                    then_b = build_stmts(cfg, n->child[1], then_b);
+                    else_b = build_stmts(cfg, n->child[2], else_b);
+                    if (then_b != NULL) {
+                        add_edge(then_b, join);
+                    }
+                    if (else_b != NULL) {
+                        add_edge(else_b, join);
+                    }
+                    cur = join;
+                    break;
+                case STMT_WHILE:
+                    join = new_block(cfg);
+                    add_edge(cur, join);
+                    join->branch = n;
+
+                    then_b = new_block(cfg);
+                    else_b = new_block(cfg);
+                    if (!is_const_cond(n->child[0], &value) || value != 0) {
+                        add_edge(join, then_b);
+                    }
+                    if (!is_const_cond(n->child[0], &value) || value == 0) {
+                        add_edge(join, else_b);
+                    }
+
+                    then_b = build_stmts(cfg, n->child[1], then_b);
+                    if (then_b != NULL) {
+                        add_edge(then_b, join);
+                    }
+                    cur = else_b;
+                    break;
+                case STMT_RETURN:
+                    cur->branch = n;
+                    add_edge(cur, cfg->exit);
+                    cur = NULL;
+                    break;
+                default:
+                    printf("Error: build_stmts()\n");
+                    exit(GENERATOR_ERROR);
+            }
+        }
+        n = n->sibling;
+    }
+    return cur;
+}
+
+static void mark_reachable(Block* b)
+{
+    if (b->reachable) {
+        return;
+    }
+    b->reachable = true;
+    for (int i = 0; i < b->num_succ; ++i) {
+        mark_reachable(b->succ[i]);
+    }
+}
+
+static void use_all(Cfg* cfg, Node* n, bool* live)
+{
+    int v = -1;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && ((v = find_var(cfg, n->token_str)) >= 0)) {
+            live[v] = true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            use_all(cfg, n->child[i], live);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/**
+ * Control flow graph and liveness analysis over a single function.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "ast.h"
+
+/* Data Structures */
+typedef struct Block {
+    int id;
+
+    Node** stmts;  // Expression statements, in execution order
+    int num_stmts;
+    int cap_stmts;
+    Node* branch;  // Terminating if, while or return statement, if any
+
+    struct Block* succ[2];
+    int num_succ;
+    int num_preds;
+    bool reachable;
+
+    bool* live_in;
+    bool* live_out;
+    bool* dom;     // Blocks that dominate this one, by id
+} Block;
+
+typedef struct Cfg {
+    Node* func;
+
+    Block** blocks;
+    int num_blocks;
+    int cap_blocks;
+
+    Block* entry;
+    Block* exit;
+
+    char** vars;   // Scalar locals and parameters, the tracked variables
+    int num_vars;
+    int cap_vars;
+} Cfg;
+
+/* Function Prototypes */
+Cfg* build_cfg(Node* func);
+void free_cfg(Cfg* cfg);
+void compute_liveness(Cfg* cfg);
+void compute_dominators(Cfg* cfg);
+bool* natural_loop(Cfg* cfg, Block* header);
+void transfer_expr(Cfg* cfg, Node* n, bool* live);
+
+int find_var(Cfg* cfg, char* id);
+bool is_const_cond(Node* n, int* value);
+bool can_complete(Node* n);
@@ -1,23 +1,105 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "analyser.h"
 #include "ast.h"
+#include "cfg.h"
 #include "parser.h"
+#include "profile.h"
+#include "schedule.h"
 #include "shared.h"
 #include "symbol.h"
 
 #include "cgen.h"
 #include "generate.c"
 
+/**
+ * The relation that holds exactly when `op` does not.
+ */
+static char* negate_relop(char* op)
+{
+    if (!strcmp(op, "<")) {
+        return ">=";
+    } else if (!strcmp(op, "<=")) {
+        return ">";
+    } else if (!strcmp(op, ">")) {
+        return "<=";
+    } else if (!strcmp(op, ">=")) {
+        return "<";
+    } else if (!strcmp(op, "==")) {
+        return "!=";
+    } else if (!strcmp(op, "!=")) {
+        return "==";
+    }
+    printf("Error: negate_relop()\n");
+    exit(GENERATOR_ERROR);
+}
+
+/**
+ * The relation with its operands exchanged, `a op b` being `b swap(op) a`.
+ */
+static char* swap_relop(char* op)
+{
+    if (!strcmp(op, "<")) {
+        return ">";
+    } else if (!strcmp(op, "<=")) {
+        return ">=";
+    } else if (!strcmp(op, ">")) {
+        return "<";
+    } else if (!strcmp(op, ">=")) {
+        return "<=";
+    }
+    return op;
+}
+
+/**
+ * Which operand of a sum or product to evaluate first. A constant on the
+ * left goes second, where it can become an immediate operand.
+ */
+static int first_operand(Node* n)
+{
+    bool commutes = !strcmp(n->token_str, "+") || !strcmp(n->token_str, "*");
+    return (commutes && (n->child[0]->kind == NODE_FACTOR) &&
+            (n->child[1]->kind != NODE_FACTOR) &&
+            (n->child[1]->kind != NODE_SEXPR)) ? 1 : 0;
+}
+
+/**
+ * A tail call replaces our frame with the callee's, so a callee without a
+ * frame of its own is called as normal, as is one that takes more stack
+ * arguments than there is room for.
+ */
+static bool is_tail_call(Node* n, Scope* s)
+{
+    if ((n == NULL) || (n->kind != NODE_CALL) ||
+            (n->element.call->call_kind != CALL_TAIL)) {
+        return false;
+    }
+
+    // The callee's stack arguments go where ours were passed
+    Symbol* func = get_func(&s);
+    Symbol* callee = get_sym(&s, n->token_str);
+    return !callee->frameless && (callee->len - num_reg_params(callee) <=
+                                  func->len - num_reg_params(func));
+}
+
 /**
  * call => ID \( args \)
  */
 void cgen_call(Node* n, Scope* s, Target* target)
 {
     assert((n != NULL) && (s != NULL));
-    gen_func_call(n, s, target);
+
+    if (n->element.call->call_kind == CALL_INLINE) {
+        gen_inline_call(n, s, target);
+    } else if (is_tail_call(n, s)) {
+        gen_tail_call(n, s, target);
+    } else {
+        gen_func_call(n, s, target);
+    }
 }
 
 /**
@@ -47,15 +129,15 @@ void cgen_addit(Node* n, Scope* s, Target* target)
 {
     assert((n != NULL) && (s != NULL));
 
-    cgen_term(n->child[0], s, target);
+    int first = first_operand(n);
+    cgen_term(n->child[first], s, target);
+    if (gen_add_imm(n, n->child[1 - first], target)) {
+        return;
+    }
     gen_addit_e1(n, target);
 
-    cgen_term(n->child[1], s, target);
+    cgen_term(n->child[1 - first], s, target);
     gen_addit_e2(n, target, n->token_str);
-
-    while (n->sibling != NULL) {
-        cgen_addit(n->sibling, s, target);
-    }
 }
 
 /**
@@ -66,6 +148,21 @@ void cgen_sexpr(Node* n, Scope* s, Target* target)
     assert((n != NULL) && (s != NULL));
 
     if (n->element.sexpr->simple_expression_kind == SEXPR_RELOP) {
+        char* op = n->token_str;
+        if ((n->child[1]->kind == NODE_FACTOR) &&
+                fits_relop_imm(op, atoi(n->child[1]->token_str))) {
+            cgen_addop(n->child[0], s, target);
+            gen_relop_imm(target, op, atoi(n->child[1]->token_str));
+            return;
+        }
+        if ((n->child[0]->kind == NODE_FACTOR) &&
+                fits_relop_imm(swap_relop(op), atoi(n->child[0]->token_str))) {
+            cgen_addop(n->child[1], s, target);
+            gen_relop_imm(target, swap_relop(op),
+                    atoi(n->child[0]->token_str));
+            return;
+        }
+
         cgen_addop(n->child[0], s, target);
         gen_addit_e1(n, target);
 
@@ -84,12 +181,16 @@ void cgen_addop(Node* n, Scope* s, Target* target)
     if (n->kind != NODE_ADDIT) {
         cgen_term(n, s, target);
     } else {
-        cgen_term(n->child[0], s, target);
+        int first = first_operand(n);
+        cgen_term(n->child[first], s, target);
+        if (gen_add_imm(n, n->child[1 - first], target)) {
+            return;
+        }
         gen_addit_e1(n, target);
         if (n->child[1]->kind == NODE_SEXPR) {
             cgen_sexpr(n->child[1], s, target);
         } else {
-            cgen_term(n->child[1], s, target);
+            cgen_term(n->child[1 - first], s, target);
             gen_addit_e2(n, target, n->token_str);
         }
     }
@@ -105,9 +206,14 @@ void cgen_term(Node* n, Scope* s, Target* target)
     if (n->kind != NODE_TERM) {
         cgen_factor(n, s, target);
     } else {
-        cgen_factor(n->child[0], s, target);
+        int first = first_operand(n);
+        cgen_factor(n->child[first], s, target);
+        if (gen_mul_imm(n, n->child[1 - first], target) ||
+                gen_div_imm(n, target)) {
+            return;
+        }
         gen_addit_e1(n, target);
-        cgen_factor(n->child[1], s, target);
+        cgen_factor(n->child[1 - first], s, target);
         gen_addit_e2(n, target, n->token_str);
     }
 }
@@ -193,6 +299,55 @@ void cgen_expr(Node* n, Scope* s, Target* target)
     }
 }
 
+/**
+ * Branch to `label` when the truth of a condition matches `when`, falling
+ * through otherwise. Relational conditions compare and branch directly
+ * rather than materialising a 0/1 value to test against zero.
+ */
+void cgen_cond(Node* n, Scope* s, Target* target, bool when, char* label,
+        int num)
+{
+    assert((n != NULL) && (s != NULL));
+
+    int value = 0;
+    if (is_const_cond(n, &value)) {
+        if ((value != 0) == when) {
+            gen_branch(target, label, num);
+        }
+        return;
+    }
+
+    if ((n->kind != NODE_SEXPR) ||
+            (n->element.sexpr->simple_expression_kind != SEXPR_RELOP)) {
+        cgen_expr(n, s, target);
+        gen_branch_zero(target, when ? "!=" : "==", label, num);
+        return;
+    }
+
+    char* op = when ? n->token_str : negate_relop(n->token_str);
+    if (is_const_cond(n->child[1], &value) && (value == 0)) {
+        cgen_addop(n->child[0], s, target);
+        gen_branch_zero(target, op, label, num);
+    } else if (is_const_cond(n->child[0], &value) && (value == 0)) {
+        cgen_addop(n->child[1], s, target);
+        gen_branch_zero(target, swap_relop(op), label, num);
+    } else if ((n->child[1]->kind == NODE_FACTOR) &&
+            fits_relop_imm(op, atoi(n->child[1]->token_str))) {
+        cgen_addop(n->child[0], s, target);
+        gen_branch_imm(target, op, atoi(n->child[1]->token_str), label, num);
+    } else if ((n->child[0]->kind == NODE_FACTOR) &&
+            fits_relop_imm(swap_relop(op), atoi(n->child[0]->token_str))) {
+        cgen_addop(n->child[1], s, target);
+        gen_branch_imm(target, swap_relop(op), atoi(n->child[0]->token_str),
+                label, num);
+    } else {
+        cgen_addop(n->child[0], s, target);
+        gen_addit_e1(n, target);
+        cgen_addop(n->child[1], s, target);
+        gen_branch_cmp(target, op, label, num);
+    }
+}
+
 /**
  * selection_stmt => if \( expression \) statement |
  *					 if \( expression \) statement else statement
@@ -224,7 +379,13 @@ void cgen_ret(Node* n, Scope* s, Target* target)
         gen_return(n->child[0], s, target);
     }
 
-    gen_return_exit(n, f, target);
+    if (is_tail_call(n->child[0], s)) {
+        // The callee returns to our caller itself
+    } else if (target->inline_exit >= 0) {
+        gen_inline_return(target);
+    } else {
+        gen_return_exit(n, f, target);
+    }
 }
 
 /**
@@ -233,10 +394,11 @@ void cgen_ret(Node* n, Scope* s, Target* target)
  */
 void cgen_stmts(Node* n, Scope* s, Target* target)
 {
-    assert((n != NULL) && (s != NULL));
+    assert(s != NULL);
 
     while (n != NULL) {
         if (n->kind == NODE_STMT) {
+            gen_count(n, target);
             switch (n->element.stmt->statement_kind) {
                 case STMT_EXPR:
                     cgen_expr(n, s, target);
@@ -269,8 +431,9 @@ void cgen_decs(Node* n, Scope* s, Target* target)
 {
     assert(s != NULL);
 
-    // Start at 4 as $ra is already on the stack
-    int offset = 4;
+    // Start below $ra, the caller's $fp and the parameters passed in
+    // registers
+    int offset = 8 + num_reg_params(get_func(&s)) * 4;
     while (n != NULL) {
         assert((n->element.decl->declaration_kind == DEC_VAR) &&
                 (n->kind == NODE_DEC));
@@ -285,10 +448,12 @@ void cgen_decs(Node* n, Scope* s, Target* target)
             .local = true
         };
 
-        local->offset = -offset;
-        offset += local->cat == CAT_VAR_SIN ? 4 : local->len * 4;
-
-        gen_func_locals(n, local, target);
+        if (get_func(&s)->frameless) {
+            local->reg = leaf_regs[target->regs_used++];
+        } else {
+            local->offset = -offset;
+            offset += local->cat == CAT_VAR_SIN ? 4 : local->len * 4;
+        }
         add_symbol(&s, local);
         n = n->sibling;
     }
@@ -303,6 +468,7 @@ void cgen_cstmt(Node* n, Scope* s, Target* target)
     assert((n->element.cstmt->compound_statement_kind == CSTMT_MAIN) &&
             (n->kind == NODE_CSTMT));
 
+    gen_count(n, target);
     cgen_decs(n->child[0], s, target);
     cgen_stmts(n->child[1], s, target);
 }
@@ -314,7 +480,7 @@ void cgen_params(Node* n, Scope* s, Target* target)
 {
     assert((n != NULL) && (s != NULL));
 
-    int offset = 4;
+    int i = 0;
     while (n != NULL) {
         if (n->kind == NODE_PARAMS) {
             if (n->element.params->parameter_kind == PARAM_VOID) {
@@ -330,8 +496,20 @@ void cgen_params(Node* n, Scope* s, Target* target)
                     .type = n->element.params->type
                 };
 
-                local->offset = offset;
-                offset += 4;
+                // The first few are passed in registers and kept below
+                // the saved registers, the rest are above them in the
+                // caller's outgoing argument area
+                if (i >= NUM_ARG_REGS) {
+                    local->offset = (i - NUM_ARG_REGS + 1) * 4;
+                } else {
+                    local->offset = -(i + 2) * 4;
+                }
+
+                if (get_func(&s)->frameless) {
+                    local->reg = (i > 0) && (i < NUM_ARG_REGS) ?
+                            arg_regs[i] : leaf_regs[target->regs_used++];
+                }
+                i += 1;
                 add_symbol(&s, local);
             }
         }
@@ -344,6 +522,12 @@ void cgen_params(Node* n, Scope* s, Target* target)
  */
 void cgen(Node* n, Target* target)
 {
+    // Generate into a temporary file when there's a schedule to fix up
+    FILE* out = target->out;
+    if (options.delay_slots) {
+        target->out = new_stream();
+    }
+
     Scope* s = init_scope();
     enter_scope(&s);
 
@@ -367,37 +551,97 @@ void cgen(Node* n, Target* target)
             add_symbol(&s, global_var);
             gen_global_var(n, global_var, target);
         } else if (n->element.decl->declaration_kind == DEC_FUNC) {
+            hoist_block_decls(n);
+
             Symbol* global_func = init_symbol();
             *global_func = (Symbol) {
                 .id = n->token_str,
                 .cat = CAT_FUNC,
                 .type = n->element.decl->type,
                 .len = count_params(n->child[0]),
-                .offset = count_local_space(n->child[1]->child[0])
+                .offset = count_local_space(n->child[1]->child[0]),
+                .frameless = is_frameless(n),
+                .early_exits = count_early_exits(n)
             };
 
+            global_func->offset += num_reg_params(global_func) * 4;
+
             add_symbol(&s, global_func);
+            if (global_func->frameless) {
+                remark("'%s' is a leaf, compiled without a frame",
+                        n->token_str);
+            }
+            if (global_func->early_exits > 0) {
+                remark("'%s' tests %d early exit(s) before setting up its "
+                        "frame", n->token_str, global_func->early_exits);
+                count_stat("shrink-wrap: early exits",
+                        global_func->early_exits);
+            }
 
             enter_scope(&s);
+            target->regs_used = 0;
+            target->out_args = count_out_args(n->child[1]);
+            target->depth = 0;
+            target->max_depth = 0;
             cgen_params(n->child[0], s, target);
 
+            // The body and exit go first, as the frame has room for the
+            // most temporaries the body uses at once. The early exits are
+            // kept apart, to go ahead of the frame's set-up.
+            FILE* text = target->out;
+            target->out = new_stream();
+            gen_count(n->child[1], target);
+            cgen_decs(n->child[1]->child[0], s, target);
+            allocate_registers(n, s, target);
+            Node* arm = NULL;
+            Node* rest = gen_early_exits(n, s, target, &arm);
+            FILE* early = target->out;
+            target->early_depth = target->max_depth;
+
+            target->out = new_stream();
+            cgen_stmts(arm, s, target);
+            cgen_stmts(rest, s, target);
+            assert(target->depth == 0);
+
             if (!strcmp(n->token_str, "main")) {
-                gen_main_entry(n, global_func, target);
+                gen_main_exit(n, global_func, target);
+            } else if (global_func->frameless) {
+                gen_leaf_exit(n, global_func, target);
             } else {
-                gen_funcdef_entry(n, global_func, target);
+                gen_funcdef_exit(n, global_func, target);
             }
+            FILE* body = target->out;
+            target->out = text;
 
-            cgen_cstmt(n->child[1], s, target);
+            if (options.omit_fp && !global_func->frameless) {
+                target->frame = frame_size(global_func, target);
+            }
 
             if (!strcmp(n->token_str, "main")) {
-                gen_main_exit(n, global_func, target);
+                gen_main_entry(n, global_func, early, target);
+            } else if (global_func->frameless) {
+                gen_leaf_entry(n, s, early, target);
             } else {
-                gen_funcdef_exit(n, global_func, target);
+                gen_funcdef_entry(n, s, early, target);
             }
+            copy_stream(body, target);
+            gen_cold_blocks(target);
+            target->frame = -1;
             exit_scope(&s);
         }
         n = n->sibling;
     }
 
     exit_scope(&s);
+
+    if (options.profile_generate) {
+        gen_profile_data(target);
+    }
+
+    if (options.delay_slots) {
+        rewind(target->out);
+        schedule(target->out, out);
+        fclose(target->out);
+        target->out = out;
+    }
 }
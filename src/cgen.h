@@ -13,6 +13,15 @@ typedef struct Target {
     char* filename;
     bool in_code;
     int label_count;
+    int inline_exit; // Label that returns jump to in an inlined body, or -1
+    int regs_used;   // Registers given to the current leaf's variables
+    FILE* cold;      // Arms placed after the current function, or NULL
+    int out_args;    // Words of the current frame's outgoing arguments
+    int depth;       // Temporaries in use
+    int max_depth;   // Most temporaries in use at once, sizing the frame
+    int frame;       // Size of a frame addressed from $sp, copied out, or -1
+    bool unframed;   // Generating early exits, before the frame is set up
+    int early_depth; // Most temporaries the early exits use at once
 } Target;
 
 /* Function Prototypes */
@@ -27,6 +36,8 @@ void cgen_stmts(Node* n, Scope* s, Target* target);
 void cgen_if(Node* n, Scope* s, Target* target);
 void cgen_expr(Node* n, Scope* s, Target* target);
 void cgen_while(Node* n, Scope* s, Target* target);
+void cgen_cond(Node* n, Scope* s, Target* target, bool when, char* label,
+        int num);
 void cgen_ret(Node* n, Scope* s, Target* target);
 
 void cgen_call(Node* n, Scope* s, Target* target);
@@ -1,43 +1,119 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "analyser.h"
 #include "ast.h"
 #include "cgen.h"
 #include "lexer.h"
+#include "optimise.h"
 #include "parser.h"
+#include "profile.h"
 #include "symbol.h"
 #include "shared.h"
 
 #include "tree-walker.c"
 
-#define INPUT_FILE_POS   1
-#define OUTPUT_FILE_POS  3
 #define DEFAULT_OUT_NAME "a.out"
+#define USAGE "Usage: cmm <filename> [-o <output>] [-O0|-O1|-O2] " \
+              "[--passes=<pass>,...] [--time-passes] [--dump-passes] " \
+              "[--inline-threshold=<n>] [--unroll=<n>] [--unroll-limit=<n>] " \
+              "[--small-data=<n>] " \
+              "[--delay-slots] [-fomit-frame-pointer] [-fwhole-program] " \
+              "[--profile-generate] [--profile-use=<file>] [--remarks] " \
+              "[--stats]\n"
 
 void run(Input* input, Target* output)
 {
     Token* tokens = lex(input);
     Node* ast = parse(tokens, input);
     analyse(ast);
+    number_sites(ast);
+    if (options.profile_use != NULL) {
+        read_profile(options.profile_use);
+    }
+    optimise(ast);
     cgen(ast, output);
+    print_stats();
+}
+
+/**
+ * Read a non-negative integer option value that fits in an int, or exit
+ * with the usage message.
+ */
+int parse_count(const char* value)
+{
+    char* end = NULL;
+    errno = 0;
+    long count = strtol(value, &end, 10);
+    if ((*value == '\0') || (*end != '\0') || (errno == ERANGE) ||
+            (count < 0) || (count > INT_MAX)) {
+        printf(USAGE);
+        exit(ARGC_ERROR);
+    }
+    return (int) count;
 }
 
 int main(int argc, char* argv[])
 {
-    if (!(argc == 2 || argc == 4)) {
-        printf("Usage: cmm <filename> [-o <output>]\n");
+    char* input_filename = NULL;
+    char* output_filename = DEFAULT_OUT_NAME;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-o") && (i + 1 < argc)) {
+            output_filename = argv[++i];
+        } else if (!strcmp(argv[i], "-O0") || !strcmp(argv[i], "-O1") ||
+                !strcmp(argv[i], "-O2")) {
+            options.level = argv[i][2] - '0';
+        } else if (!strncmp(argv[i], "--passes=", 9)) {
+            options.passes = argv[i] + 9;
+            check_pipeline(options.passes);
+        } else if (!strcmp(argv[i], "--time-passes")) {
+            options.time_passes = true;
+        } else if (!strcmp(argv[i], "--dump-passes")) {
+            options.dump_passes = true;
+        } else if (!strncmp(argv[i], "--inline-threshold=", 19)) {
+            options.inline_threshold = parse_count(argv[i] + 19);
+        } else if (!strncmp(argv[i], "--unroll=", 9)) {
+            options.unroll = parse_count(argv[i] + 9);
+        } else if (!strncmp(argv[i], "--unroll-limit=", 15)) {
+            options.unroll_limit = parse_count(argv[i] + 15);
+        } else if (!strncmp(argv[i], "--small-data=", 13)) {
+            options.small_data = parse_count(argv[i] + 13);
+        } else if (!strcmp(argv[i], "--delay-slots")) {
+            options.delay_slots = true;
+        } else if (!strcmp(argv[i], "-fomit-frame-pointer")) {
+            options.omit_fp = true;
+        } else if (!strcmp(argv[i], "-fwhole-program")) {
+            options.whole_program = true;
+        } else if (!strcmp(argv[i], "--profile-generate")) {
+            options.profile_generate = true;
+        } else if (!strncmp(argv[i], "--profile-use=", 14)) {
+            options.profile_use = argv[i] + 14;
+        } else if (!strcmp(argv[i], "--remarks")) {
+            options.remarks = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            options.stats = true;
+        } else if ((argv[i][0] != '-') && (input_filename == NULL)) {
+            input_filename = argv[i];
+        } else {
+            printf(USAGE);
+            exit(ARGC_ERROR);
+        }
+    }
+
+    if (input_filename == NULL) {
+        printf(USAGE);
         exit(ARGC_ERROR);
     }
 
-    struct String program_text = read_whole_file(argv[INPUT_FILE_POS]);
+    struct String program_text = read_whole_file(input_filename);
     if (program_text.buffer == NULL) {
         return EXIT_FAILURE;
     }
 
-    char* output_filename = argc == 4 ?
-                            argv[OUTPUT_FILE_POS] : DEFAULT_OUT_NAME;
-
     FILE* fd = fopen(output_filename, "w");
     if (!fd) {
         perror("File opening failed");
@@ -58,7 +134,9 @@ int main(int argc, char* argv[])
         .filename = output_filename,
         .out = fd,
         .in_code = true,
-        .label_count = 0
+        .label_count = 0,
+        .inline_exit = -1,
+        .frame = -1
     };
 
     run(input, output);
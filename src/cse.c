@@ -0,0 +1,494 @@
+/**
+ * Common subexpression elimination by value numbering.
+ *
+ * The statements of a function are walked in order, keeping the pure
+ * expressions already evaluated whose operands have not been written since.
+ * An expression matching one of them is given the same value number, and
+ * every value evaluated more than once is computed a single time into a new
+ * local, just before the statement that first needs it.
+ *
+ * What is known flows into the branches of an if statement, which its
+ * condition dominates, and on past the if or a while loop as long as nothing
+ * inside it writes an operand. A store to any array forgets every load, and
+ * a call forgets loads and globals besides.
+ *
+ * Only statements whose pure parts are evaluated before anything with an
+ * effect are numbered, so that computing them first changes nothing: at most
+ * one call, as the whole of the statement or the value it assigns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "optimise.h"
+#include "shared.h"
+
+typedef struct Value {
+    Node** uses;        // The first is where the value is first needed
+    int num_uses;
+    int cap_uses;
+    int site;           // The statement it is computed in front of
+} Value;
+
+typedef struct Available {
+    int* values;
+    int num;
+    int cap;
+} Available;
+
+typedef struct Effects {
+    char** written;     // Scalars assigned
+    int num_written;
+    int cap_written;
+    bool stores;        // Stores to an array
+    bool calls;         // Calls a function, which may write any global
+} Effects;
+
+typedef struct Numberer {
+    Node* func;
+
+    Value* values;
+    int num_values;
+    int cap_values;
+
+    Node*** sites;      // Where to insert in front of each statement
+    int num_sites;
+    int cap_sites;
+} Numberer;
+
+static void number_stmts(Numberer* nb, Node** link, Available* avail);
+static void number_stmt(Numberer* nb, Node** link, Node* n,
+        Available* avail);
+static void number_expr(Numberer* nb, Node* n, int site, Available* avail);
+static bool is_orderly(Node* n);
+static bool is_candidate(Numberer* nb, Node* n);
+static int find_value(Numberer* nb, Available* avail, Node* n);
+static int new_value(Numberer* nb, Node* n, int site);
+static void add_use(Value* v, Node* n);
+static int new_site(Numberer* nb, Node** link);
+static void forget(Numberer* nb, Available* avail, Node* n);
+static void scan_effects(Effects* e, Node* n);
+static bool is_affected(Numberer* nb, Effects* e, Node* n);
+static Available copy_available(Available* avail);
+static void replace_values(Numberer* nb);
+static int compare_size(const void* a, const void* b);
+static int cost(Node* n);
+
+/**
+ * Compute each repeated expression of every function once.
+ */
+void eliminate_common_subexpressions(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->element.decl->declaration_kind != DEC_FUNC) {
+            continue;
+        }
+
+        Numberer nb = { .func = n };
+        Available avail = { 0 };
+
+        number_stmts(&nb, &n->child[1]->child[1], &avail);
+        replace_values(&nb);
+
+        for (int i = 0; i < nb.num_values; ++i) {
+            free(nb.values[i].uses);
+        }
+        free(nb.values);
+        free(nb.sites);
+        free(avail.values);
+    }
+}
+
+/* Private */
+
+/**
+ * Number a list of statements, given by the link to its first.
+ */
+static void number_stmts(Numberer* nb, Node** link, Available* avail)
+{
+    for (; *link != NULL; link = &(*link)->sibling) {
+        Node* n = *link;
+        if (n->kind == NODE_CSTMT) {
+            number_stmts(nb, &n->child[1], avail);
+            continue;
+        }
+        if (n->kind != NODE_STMT) {
+            continue;
+        }
+
+        Available branch = { 0 };
+        switch (n->element.stmt->statement_kind) {
+            case STMT_EXPR:
+            case STMT_RETURN:
+                if (n->child[0] != NULL) {
+                    number_stmt(nb, link, n->child[0], avail);
+                }
+                break;
+            case STMT_IF:
+                number_stmt(nb, link, n->child[0], avail);
+
+                branch = copy_available(avail);
+                number_stmts(nb, &n->child[1], &branch);
+                free(branch.values);
+                branch = copy_available(avail);
+                number_stmts(nb, &n->child[2], &branch);
+                free(branch.values);
+
+                forget(nb, avail, n->child[1]);
+                forget(nb, avail, n->child[2]);
+                break;
+            case STMT_WHILE:
+                // Only what the loop leaves alone holds on every trip
+                forget(nb, avail, n->child[0]);
+                forget(nb, avail, n->child[1]);
+
+                branch = copy_available(avail);
+                number_stmts(nb, &n->child[1], &branch);
+                free(branch.values);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Number the expression of a statement, then forget whatever it writes.
+ */
+static void number_stmt(Numberer* nb, Node** link, Node* n,
+        Available* avail)
+{
+    if (is_orderly(n)) {
+        number_expr(nb, n, new_site(nb, link), avail);
+    }
+    forget(nb, avail, n);
+}
+
+/**
+ * Give the expression and its parts value numbers, outermost first. A part
+ * of an expression already available is not looked at again.
+ */
+static void number_expr(Numberer* nb, Node* n, int site, Available* avail)
+{
+    if (n == NULL) {
+        return;
+    }
+
+    if (is_candidate(nb, n)) {
+        int v = find_value(nb, avail, n);
+        if (v >= 0) {
+            add_use(&nb->values[v], n);
+            return;
+        }
+
+        v = new_value(nb, n, site);
+        if (avail->num == avail->cap) {
+            avail->cap = avail->cap ? avail->cap * 2 : 8;
+            avail->values = realloc(avail->values, sizeof(int) * avail->cap);
+        }
+        avail->values[avail->num++] = v;
+    }
+
+    switch (n->kind) {
+        case NODE_EXPR:
+            number_expr(nb, n->child[1], site, avail);
+            number_expr(nb, n->child[0]->child[0], site, avail);
+            break;
+        case NODE_VAR:
+            number_expr(nb, n->child[0], site, avail);
+            break;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            number_expr(nb, n->child[0], site, avail);
+            number_expr(nb, n->child[1], site, avail);
+            break;
+        case NODE_CALL:
+            for (Node* arg = n->child[0]; arg != NULL; arg = arg->sibling) {
+                number_expr(nb, arg, site, avail);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * True if every pure part of the statement's expression is evaluated before
+ * anything with an effect: it is pure, or a call with pure arguments, or an
+ * assignment of either to a target with a pure index.
+ */
+static bool is_orderly(Node* n)
+{
+    if (n->kind == NODE_EXPR) {
+        if (has_side_effects(n->child[0]->child[0])) {
+            return false;
+        }
+        n = n->child[1];
+    }
+    if ((n->kind == NODE_CALL) &&
+            (n->element.call->call_kind != CALL_INLINE)) {
+        for (Node* arg = n->child[0]; arg != NULL; arg = arg->sibling) {
+            if (has_side_effects(arg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return !has_side_effects(n);
+}
+
+/**
+ * Arithmetic, array addresses and reads, and reads of globals and through
+ * pointers. A local or a constant is as cheap to read as a temporary.
+ */
+static bool is_candidate(Numberer* nb, Node* n)
+{
+    switch (n->kind) {
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return !has_side_effects(n);
+        case NODE_VAR:
+            return !has_side_effects(n) && ((n->child[0] != NULL) ||
+                    is_deref(n) || !declares(nb->func, n->token_str));
+        default:
+            return false;
+    }
+}
+
+static int find_value(Numberer* nb, Available* avail, Node* n)
+{
+    for (int i = 0; i < avail->num; ++i) {
+        int v = avail->values[i];
+        if (same_tree(nb->values[v].uses[0], n)) {
+            return v;
+        }
+    }
+    return -1;
+}
+
+static int new_value(Numberer* nb, Node* n, int site)
+{
+    if (nb->num_values == nb->cap_values) {
+        nb->cap_values = nb->cap_values ? nb->cap_values * 2 : 8;
+        nb->values = realloc(nb->values, sizeof(Value) * nb->cap_values);
+    }
+    Value* v = &nb->values[nb->num_values];
+    *v = (Value) { .site = site };
+    add_use(v, n);
+    return nb->num_values++;
+}
+
+static void add_use(Value* v, Node* n)
+{
+    if (v->num_uses == v->cap_uses) {
+        v->cap_uses = v->cap_uses ? v->cap_uses * 2 : 4;
+        v->uses = realloc(v->uses, sizeof(Node*) * v->cap_uses);
+    }
+    v->uses[v->num_uses++] = n;
+}
+
+/**
+ * The site in front of the statement at `link`, shared by every value the
+ * statement first needs.
+ */
+static int new_site(Numberer* nb, Node** link)
+{
+    if ((nb->num_sites > 0) && (nb->sites[nb->num_sites - 1] == link)) {
+        return nb->num_sites - 1;
+    }
+    if (nb->num_sites == nb->cap_sites) {
+        nb->cap_sites = nb->cap_sites ? nb->cap_sites * 2 : 8;
+        nb->sites = realloc(nb->sites, sizeof(Node**) * nb->cap_sites);
+    }
+    nb->sites[nb->num_sites] = link;
+    return nb->num_sites++;
+}
+
+/**
+ * Drop the available values that anything under `n` may change.
+ */
+static void forget(Numberer* nb, Available* avail, Node* n)
+{
+    Effects e = { 0 };
+    scan_effects(&e, n);
+
+    int kept = 0;
+    for (int i = 0; i < avail->num; ++i) {
+        int v = avail->values[i];
+        if (!is_affected(nb, &e, nb->values[v].uses[0])) {
+            avail->values[kept++] = v;
+        }
+    }
+    avail->num = kept;
+    free(e.written);
+}
+
+/**
+ * Everything `n` may write, including in inlined bodies.
+ */
+static void scan_effects(Effects* e, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_EXPR) {
+            Node* target = n->child[0];
+            if ((target->child[0] != NULL) || is_deref(target)) {
+                e->stores = true;
+            } else {
+                if (e->num_written == e->cap_written) {
+                    e->cap_written = e->cap_written ?
+                            e->cap_written * 2 : 8;
+                    e->written = realloc(e->written,
+                            sizeof(char*) * e->cap_written);
+                }
+                e->written[e->num_written++] = target->token_str;
+            }
+        } else if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE) &&
+                strcmp(n->token_str, "input") &&
+                strcmp(n->token_str, "output")) {
+            e->calls = true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            scan_effects(e, n->child[i]);
+        }
+    }
+}
+
+/**
+ * True if the expression reads something with the given effects may write.
+ */
+static bool is_affected(Numberer* nb, Effects* e, Node* n)
+{
+    if (n == NULL) {
+        return false;
+    }
+
+    switch (n->kind) {
+        case NODE_VAR:
+            for (int i = 0; i < e->num_written; ++i) {
+                if (!strcmp(e->written[i], n->token_str)) {
+                    return true;
+                }
+            }
+            if ((n->element.var->variable_kind != VAR_ADDRESS) &&
+                    ((n->child[0] != NULL) || is_deref(n)) &&
+                    (e->stores || e->calls)) {
+                return true;
+            }
+            if (e->calls && !declares(nb->func, n->token_str)) {
+                return true;
+            }
+            return is_affected(nb, e, n->child[0]);
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return is_affected(nb, e, n->child[0]) ||
+                    is_affected(nb, e, n->child[1]);
+        default:
+            return false;
+    }
+}
+
+static Available copy_available(Available* avail)
+{
+    Available copy = { .num = avail->num, .cap = avail->num };
+    if (avail->num > 0) {
+        copy.values = malloc(sizeof(int) * avail->num);
+        memcpy(copy.values, avail->values, sizeof(int) * avail->num);
+    }
+    return copy;
+}
+
+/**
+ * Compute each value needed more than once into a temporary. The smallest
+ * go first, so that a value used within a larger one is already in its
+ * temporary when the larger is computed.
+ */
+static void replace_values(Numberer* nb)
+{
+    Value** order = malloc(sizeof(Value*) * (nb->num_values + 1));
+    for (int i = 0; i < nb->num_values; ++i) {
+        order[i] = &nb->values[i];
+    }
+    qsort(order, nb->num_values, sizeof(Value*), compare_size);
+
+    for (int i = 0; i < nb->num_values; ++i) {
+        Value* v = order[i];
+        // Storing the value and loading it at each use must cost less than
+        // computing it again
+        if ((v->num_uses < 2) ||
+                ((v->num_uses - 1) * cost(v->uses[0]) <= v->num_uses + 1)) {
+            continue;
+        }
+
+        char* temp = fresh_local(nb->func, nb->func->token_str, "cse");
+        add_local(nb->func, temp);
+
+        // The first use moves into the temporary's assignment, along with
+        // any smaller values already replaced within it
+        Node* first = calloc(sizeof(Node), 1);
+        *first = *v->uses[0];
+        first->sibling = NULL;
+
+        Node* assign = new_assign_stmt(temp, first);
+        Node** link = nb->sites[v->site];
+        assign->sibling = *link;
+        *link = assign;
+        nb->sites[v->site] = &assign->sibling;
+
+        for (int u = 0; u < v->num_uses; ++u) {
+            Node* sibling = v->uses[u]->sibling;
+            *v->uses[u] = *new_var(temp);
+            v->uses[u]->sibling = sibling;
+        }
+
+        remark("computed a common subexpression once for its %d uses in '%s'",
+                v->num_uses, nb->func->token_str);
+        count_stat("cse: expressions computed once", 1);
+        count_stat("cse: evaluations removed", v->num_uses - 1);
+    }
+    free(order);
+}
+
+static int compare_size(const void* a, const void* b)
+{
+    Node* x = (*(Value**) a)->uses[0];
+    Node* y = (*(Value**) b)->uses[0];
+    Node* x_sibling = x->sibling;
+    Node* y_sibling = y->sibling;
+    x->sibling = NULL;
+    y->sibling = NULL;
+    int diff = count_nodes(x) - count_nodes(y);
+    x->sibling = x_sibling;
+    y->sibling = y_sibling;
+    return diff;
+}
+
+/**
+ * Roughly the instructions the generator spends evaluating an expression.
+ */
+static int cost(Node* n)
+{
+    switch (n->kind) {
+        case NODE_FACTOR:
+            return 1;
+        case NODE_VAR:
+            if (n->child[0] != NULL) {
+                // Scale the index, add the base, and load
+                return cost(n->child[0]) + 5;
+            }
+            return is_deref(n) ? 2 : 1;
+        case NODE_ADDIT:
+        case NODE_TERM:
+            if (n->child[1]->kind == NODE_FACTOR) {
+                return cost(n->child[0]) + 1;
+            }
+            // Pushing and popping the left operand
+            return cost(n->child[0]) + cost(n->child[1]) + 4;
+        default:
+            return 1;
+    }
+}
@@ -0,0 +1,294 @@
+/**
+ * Dead code and dead store elimination.
+ *
+ * Unreachable statements are found from the function's control flow graph;
+ * stores to scalar locals that are never read again are found from liveness.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "optimise.h"
+#include "shared.h"
+
+static bool remove_unreachable(Cfg* cfg);
+static bool remove_dead_stores(Cfg* cfg);
+static void hoist_decls(Node* body, Node* n);
+static void drop_stmt(Node* body, Node* n);
+static Node* prune_stmts(Node* n);
+static Node* prune_branch(Node* n);
+static void remove_unused_decls(Node* body, Node* n);
+
+/**
+ * Remove dead code from every function in the program.
+ */
+void eliminate_dead_code(Node* n)
+{
+    while (n != NULL) {
+        if (n->element.decl->declaration_kind == DEC_FUNC) {
+            Node* body = n->child[1];
+            bool changed = true;
+
+            while (changed) {
+                Cfg* cfg = build_cfg(n);
+                changed = remove_unreachable(cfg);
+                if (!changed) {
+                    compute_liveness(cfg);
+                    changed = remove_dead_stores(cfg);
+                }
+                free_cfg(cfg);
+                body->child[1] = prune_stmts(body->child[1]);
+            }
+
+            remove_unused_decls(body, body);
+        }
+        n = n->sibling;
+    }
+}
+
+/**
+ * Delete the statements of blocks that cannot be reached from the entry, and
+ * fold branches on literal conditions.
+ */
+static bool remove_unreachable(Cfg* cfg)
+{
+    Node* body = cfg->func->child[1];
+    bool changed = false;
+    int value = 0;
+
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        Node* br = b->branch;
+
+        if (!b->reachable) {
+            for (int s = 0; s < b->num_stmts; ++s) {
+                if (!is_empty_stmt(b->stmts[s])) {
+                    b->stmts[s]->child[0] = NULL;
+                    changed = true;
+                }
+            }
+            if ((br != NULL) && !is_empty_stmt(br)) {
+                drop_stmt(body, br);
+                changed = true;
+            }
+        } else if ((br != NULL) && is_const_cond(br->child[0], &value)) {
+            if (br->element.stmt->statement_kind == STMT_IF) {
+                Node* taken = value ? br->child[1] : br->child[2];
+                Node* sibling = br->sibling;
+
+                hoist_decls(body, value ? br->child[2] : br->child[1]);
+                if (taken != NULL) {
+                    *br = *taken;
+                    Node* tail = br;
+                    while (tail->sibling != NULL) {
+                        tail = tail->sibling;
+                    }
+                    tail->sibling = sibling;
+                } else {
+                    drop_stmt(body, br);
+                }
+                changed = true;
+            } else if ((br->element.stmt->statement_kind == STMT_WHILE) &&
+                    (value == 0)) {
+                drop_stmt(body, br);
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * Walk each block backwards from its live-out set, deleting stores to dead
+ * scalars and expression statements whose value is never used. Anything
+ * containing a call is kept for its side effects.
+ */
+static bool remove_dead_stores(Cfg* cfg)
+{
+    bool* live = calloc(sizeof(bool), cfg->num_vars + 1);
+    bool changed = false;
+
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        if (!b->reachable) {
+            continue;
+        }
+
+        memcpy(live, b->live_out, sizeof(bool) * cfg->num_vars);
+        if (b->branch != NULL) {
+            transfer_expr(cfg, b->branch->child[0], live);
+        }
+
+        for (int s = b->num_stmts - 1; s >= 0; --s) {
+            Node* stmt = b->stmts[s];
+            Node* e = stmt->child[0];
+
+            while (e != NULL) {
+                int v = -1;
+                if ((e->kind == NODE_EXPR) && (e->child[0]->child[0] == NULL) &&
+                        !is_deref(e->child[0]) &&
+                        ((v = find_var(cfg, e->child[0]->token_str)) >= 0) &&
+                        !live[v]) {
+                    // `x = rhs;` with x dead: keep rhs only if it must run
+                    e = has_side_effects(e->child[1]) ? e->child[1] : NULL;
+                } else if (!has_side_effects(e)) {
+                    e = NULL;
+                } else {
+                    break;
+                }
+                stmt->child[0] = e;
+                changed = true;
+            }
+
+            transfer_expr(cfg, e, live);
+        }
+    }
+
+    free(live);
+    return changed;
+}
+
+/**
+ * Move any declarations nested in a statement that is about to be deleted up
+ * to the function's own declarations, as the analyser allows them to be
+ * referenced outside of their block.
+ */
+static void hoist_decls(Node* body, Node* n)
+{
+    if (n == NULL) {
+        return;
+    }
+
+    if (n->kind == NODE_CSTMT) {
+        if (n->child[0] != NULL) {
+            Node** tail = &body->child[0];
+            while (*tail != NULL) {
+                tail = &(*tail)->sibling;
+            }
+            *tail = n->child[0];
+            n->child[0] = NULL;
+        }
+        for (Node* s = n->child[1]; s != NULL; s = s->sibling) {
+            hoist_decls(body, s);
+        }
+    } else if (n->kind == NODE_STMT) {
+        switch (n->element.stmt->statement_kind) {
+            case STMT_IF:
+                for (Node* s = n->child[1]; s != NULL; s = s->sibling) {
+                    hoist_decls(body, s);
+                }
+                for (Node* s = n->child[2]; s != NULL; s = s->sibling) {
+                    hoist_decls(body, s);
+                }
+                break;
+            case STMT_WHILE:
+                for (Node* s = n->child[1]; s != NULL; s = s->sibling) {
+                    hoist_decls(body, s);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Turn a statement into `;` in place, keeping its position in the list.
+ */
+static void drop_stmt(Node* body, Node* n)
+{
+    hoist_decls(body, n);
+
+    Node* sibling = n->sibling;
+    *n = *new_empty_stmt();
+    n->sibling = sibling;
+}
+
+/**
+ * Unlink empty statements, and any if statement left with nothing to do.
+ */
+static Node* prune_stmts(Node* n)
+{
+    Node* head = NULL;
+    Node** link = &head;
+
+    while (n != NULL) {
+        Node* next = n->sibling;
+        bool keep = true;
+
+        if (n->kind == NODE_CSTMT) {
+            n->child[1] = prune_stmts(n->child[1]);
+            keep = (n->child[0] != NULL) || (n->child[1] != NULL);
+        } else if (n->element.stmt->statement_kind == STMT_IF) {
+            n->child[1] = prune_branch(n->child[1]);
+            n->child[2] = prune_stmts(n->child[2]);
+
+            if (is_empty_stmt(n->child[1]) && (n->child[2] == NULL)) {
+                // Only the condition is left; keep it if it has effects
+                n->element.stmt->statement_kind = STMT_EXPR;
+                n->child[1] = NULL;
+                if (!has_side_effects(n->child[0])) {
+                    n->child[0] = NULL;
+                }
+            }
+        } else if (n->element.stmt->statement_kind == STMT_WHILE) {
+            n->child[1] = prune_branch(n->child[1]);
+        }
+
+        if (keep && !is_empty_stmt(n)) {
+            *link = n;
+            link = &n->sibling;
+        }
+        n = next;
+    }
+
+    *link = NULL;
+    return head;
+}
+
+/**
+ * The body of an if or while must remain a statement, even if empty.
+ */
+static Node* prune_branch(Node* n)
+{
+    Node* pruned = prune_stmts(n);
+    return pruned != NULL ? pruned : new_empty_stmt();
+}
+
+/**
+ * Drop declarations of locals that no statement refers to any more.
+ */
+static void remove_unused_decls(Node* body, Node* n)
+{
+    if (n == NULL) {
+        return;
+    }
+
+    if (n->kind == NODE_CSTMT) {
+        Node** link = &n->child[0];
+        while (*link != NULL) {
+            if (!is_referenced(body->child[1], (*link)->token_str)) {
+                *link = (*link)->sibling;
+            } else {
+                link = &(*link)->sibling;
+            }
+        }
+        for (Node* s = n->child[1]; s != NULL; s = s->sibling) {
+            remove_unused_decls(body, s);
+        }
+    } else if (n->kind == NODE_STMT) {
+        for (Node* s = n->child[1]; s != NULL; s = s->sibling) {
+            remove_unused_decls(body, s);
+        }
+        if (n->element.stmt->statement_kind == STMT_IF) {
+            for (Node* s = n->child[2]; s != NULL; s = s->sibling) {
+                remove_unused_decls(body, s);
+            }
+        }
+    }
+}
@@ -4,35 +4,268 @@
 
 #include "cgen.h"
 
-void gen_input_function(Target* target)
+static char* arg_regs[NUM_ARG_REGS] = { "$a0", "$a1", "$a2", "$a3" };
+
+// Registers the generator otherwise leaves alone, and the builtins preserve,
+// which hold the variables of a function without a frame. $fp is one of them
+// when frame pointers are omitted.
+#define NUM_LEAF_REGS 8
+static char* leaf_regs[NUM_LEAF_REGS + 1] = {
+    "$t0", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$v1", "$fp"
+};
+
+#define MAX_LINE 256
+
+static void gen_rebased(char* line, Target* target);
+static Node* early_exit_arm(Node* func, Node* stmt);
+static Node* other_arm(Node* stmt, Node* arm);
+static bool is_frame_free(Node* func, Node* n);
+static int param_index(Node* func, char* id);
+static void swap_param_regs(Node* func, Scope* s, char** regs);
+static unsigned callee_clobbers(Node* n, Scope* s, Symbol* func,
+        bool* recursive);
+static long count_uses(Node* n, char* id, int depth, long count);
+static void gen_return_value(Symbol* sym, Target* target);
+
+/**
+ * Number of registers that can hold a leaf's variables.
+ */
+int num_leaf_regs(void)
+{
+    return options.omit_fp ? NUM_LEAF_REGS + 1 : NUM_LEAF_REGS;
+}
+
+/**
+ * Number of a function's parameters that are passed in registers.
+ */
+int num_reg_params(Symbol* func)
+{
+    return func->len < NUM_ARG_REGS ? func->len : NUM_ARG_REGS;
+}
+
+void gen_input_syscall(Target* target)
 {
-    fprintf(target->out, "\n%s:\n", "input");
     fprintf(target->out, "li     $v0, 5\n");
     fprintf(target->out, "syscall\n");
     fprintf(target->out, "move   $a0, $v0\n");
+}
+
+void gen_output_syscall(Target* target)
+{
+    fprintf(target->out, "li     $v0, 1\n");
+    fprintf(target->out, "syscall\n");
+}
+
+void gen_input_function(Target* target)
+{
+    fprintf(target->out, "\n%s:\n", "input");
+    gen_input_syscall(target);
     fprintf(target->out, "jr     $ra\n");
 }
 
 void gen_output_function(Target* target)
 {
     fprintf(target->out, "\n%s:\n", "output");
+    gen_output_syscall(target);
+    fprintf(target->out, "jr     $ra\n");
+}
+
+/**
+ * Count a run of the block starting at `n`, if it is a profile site.
+ */
+void gen_count(Node* n, Target* target)
+{
+    if (!options.profile_generate || (n->site == 0)) {
+        return;
+    }
+
+    int offset = 4 * (n->site - 1);
+    fprintf(target->out, "lw     $t8, profile_counts+%d\n", offset);
+    fprintf(target->out, "addiu  $t8, $t8, 1\n");
+    fprintf(target->out, "sw     $t8, profile_counts+%d\n", offset);
+}
+
+/**
+ * Print the profile marker, then each count on a line of its own.
+ */
+void gen_profile_dump(Target* target)
+{
+    fprintf(target->out, "la     $a0, profile_marker\n");
+    fprintf(target->out, "li     $v0, 4\n");
+    fprintf(target->out, "syscall\n");
+    if (num_sites() == 0) {
+        return;
+    }
+
+    fprintf(target->out, "la     $t8, profile_counts\n");
+    fprintf(target->out, "li     $t9, %d\n", num_sites());
+    fprintf(target->out, "profile_dump:\n");
+    fprintf(target->out, "lw     $a0, 0($t8)\n");
     fprintf(target->out, "li     $v0, 1\n");
     fprintf(target->out, "syscall\n");
-    fprintf(target->out, "jr     $ra\n");
+    fprintf(target->out, "li     $a0, 10\n");
+    fprintf(target->out, "li     $v0, 11\n");
+    fprintf(target->out, "syscall\n");
+    fprintf(target->out, "addiu  $t8, $t8, 4\n");
+    fprintf(target->out, "addiu  $t9, $t9, -1\n");
+    fprintf(target->out, "bgtz   $t9, profile_dump\n");
 }
 
-void gen_func_call(Node* n, Scope* s, Target* target)
+void gen_profile_data(Target* target)
 {
-    if (!strcmp(n->token_str, "output") || !strcmp(n->token_str, "input")) {
-        fprintf(target->out, "jal    %s\n", n->token_str);
+    if (target->in_code == true) {
+        fprintf(target->out, ".data\n");
+        target->in_code = false;
+    }
+    if (num_sites() > 0) {
+        fprintf(target->out, "profile_counts: .word 0:%d\n", num_sites());
+    }
+    fprintf(target->out, "profile_marker: .asciiz \"\\n#profile\\n\"\n");
+}
+
+/**
+ * A temporary file to generate code into, for copying out later.
+ */
+FILE* new_stream(void)
+{
+    FILE* stream = tmpfile();
+    if (stream == NULL) {
+        printf("Error: new_stream(): can't create a temporary file\n");
+        exit(GENERATOR_ERROR);
+    }
+    return stream;
+}
+
+/**
+ * Copy what was generated into a temporary file to the output, and close
+ * it. Without a frame pointer the current frame is addressed from $sp, but
+ * its size isn't known until its body has been generated, so the body
+ * addresses it from $fp as usual and is rebased here.
+ */
+void copy_stream(FILE* stream, Target* target)
+{
+    char line[MAX_LINE];
+
+    rewind(stream);
+    while (fgets(line, sizeof(line), stream) != NULL) {
+        if (target->frame >= 0) {
+            gen_rebased(line, target);
+        } else {
+            fputs(line, target->out);
+        }
+    }
+    fclose(stream);
+}
+
+/**
+ * $fp points at the top of the frame, and $sp at its bottom.
+ */
+static void gen_rebased(char* line, Target* target)
+{
+    char* base = strstr(line, "($fp)");
+    size_t len = strlen(line);
+
+    if (base != NULL) {
+        // op reg, offset($fp)
+        char* offset = base;
+        while ((offset > line) && (offset[-1] != ' ')) {
+            --offset;
+        }
+        fprintf(target->out, "%.*s%d($sp)%s", (int) (offset - line), line,
+                atoi(offset) + target->frame, base + strlen("($fp)"));
+    } else if (!strncmp(line, "move   ", 7) && (len > 11) &&
+            !strcmp(line + len - 4, "$fp\n")) {
+        // move reg, $fp
+        fprintf(target->out, "addiu  %.*s$sp, %d\n", (int) (len - 11),
+                line + 7, target->frame);
+    } else {
+        fputs(line, target->out);
+    }
+}
+
+/**
+ * The stream for arms moved out of line, created on first use.
+ */
+FILE* gen_cold_stream(Target* target)
+{
+    if (target->cold == NULL) {
+        target->cold = new_stream();
+    }
+    return target->cold;
+}
+
+/**
+ * Place the arms moved out of line after the function's exit, where
+ * nothing falls through into them.
+ */
+void gen_cold_blocks(Target* target)
+{
+    if (target->cold == NULL) {
         return;
     }
-    
-    fprintf(target->out, "sw     $fp, 0($sp)\n");
-    fprintf(target->out, "addiu  $sp, $sp, -4\n");
 
+    copy_stream(target->cold, target);
+    target->cold = NULL;
+}
+
+/**
+ * Intermediate values are kept in temporaries at fixed offsets in the
+ * frame, above the outgoing arguments, and addressed from $sp, which
+ * doesn't move within a function's body.
+ */
+int temp_offset(Target* target, int depth)
+{
+    return (target->out_args + depth + 1) * 4;
+}
+
+void gen_push(Target* target, char* reg)
+{
+    fprintf(target->out, "sw     %s, %d($sp)\n", reg,
+            temp_offset(target, target->depth));
+    target->depth += 1;
+    if (target->depth > target->max_depth) {
+        target->max_depth = target->depth;
+    }
+}
+
+void gen_pop(Target* target, char* reg)
+{
+    target->depth -= 1;
+    fprintf(target->out, "lw     %s, %d($sp)\n", reg,
+            temp_offset(target, target->depth));
+}
+
+/**
+ * The size of a function's frame: the saved registers, parameters passed
+ * in registers and locals, then its temporaries and outgoing arguments. A
+ * function without a frame needs room for its temporaries alone.
+ */
+int frame_size(Symbol* func, Target* target)
+{
+    int fixed = func->frameless ? 0 : func->offset;
+    return fixed + (target->max_depth + target->out_args) * 4;
+}
+
+/**
+ * Restore $ra and the caller's $fp, and free the frame.
+ */
+void gen_frame_pop(Target* target)
+{
+    fprintf(target->out, "lw     $ra, 0($fp)\n");
+    fprintf(target->out, "move   $sp, $fp\n");
+    if (!options.omit_fp) {
+        fprintf(target->out, "lw     $fp, -4($sp)\n");
+    }
+}
+
+/**
+ * Evaluate the arguments last to first into temporaries, leaving the first
+ * argument in the last of them.
+ */
+void gen_push_args(Node* n, Scope* s, Target* target)
+{
     // Reverse the singly-linked list
-    Node* nc = n->child[0];
+    Node* nc = n;
     Node* new_root = NULL;
     while (nc) {
         Node* next = nc->sibling;
@@ -41,15 +274,161 @@ void gen_func_call(Node* n, Scope* s, Target* target)
         nc = next;
     }
 
-    // Evaluate arguments and push them onto the stack
     while (new_root != NULL) {
         cgen_expr(new_root, s, target);
-        fprintf(target->out, "sw     $a0, 0($sp)\n");
-        fprintf(target->out, "addiu  $sp, $sp, -4\n");
+        gen_push(target, "$a0");
         new_root = new_root->sibling;
     }
+}
+
+/**
+ * Put the first NUM_ARG_REGS arguments in $a0-$a3, and store the rest in
+ * the outgoing argument area at the bottom of the frame. Arguments are
+ * evaluated last to first straight into place, except those evaluated
+ * before an argument that makes a call, which would overwrite them; those
+ * are kept in temporaries, and moved once every argument is done.
+ */
+void gen_pass_args(Node* n, Scope* s, Target* target)
+{
+    int num = 0;
+    int first_call = -1;
+    for (Node* arg = n; arg != NULL; arg = arg->sibling) {
+        Node* next = arg->sibling;
+        arg->sibling = NULL;
+        if ((first_call < 0) && has_calls(arg)) {
+            first_call = num;
+        }
+        arg->sibling = next;
+        num += 1;
+    }
+    if (first_call < 0) {
+        first_call = num;
+    }
+
+    // Reverse the singly-linked list
+    Node* nc = n;
+    Node* new_root = NULL;
+    while (nc) {
+        Node* next = nc->sibling;
+        nc->sibling = new_root;
+        new_root = nc;
+        nc = next;
+    }
+
+    // The first argument is evaluated last, so is left in $a0
+    for (int i = num - 1; i >= 0; --i) {
+        cgen_expr(new_root, s, target);
+        if (i > first_call) {
+            gen_push(target, "$a0");
+        } else if (i >= NUM_ARG_REGS) {
+            fprintf(target->out, "sw     $a0, %d($sp)\n",
+                    (i - NUM_ARG_REGS + 1) * 4);
+        } else if (i > 0) {
+            fprintf(target->out, "move   %s, $a0\n", arg_regs[i]);
+        }
+        new_root = new_root->sibling;
+    }
+
+    for (int i = first_call + 1; i < num; ++i) {
+        if (i < NUM_ARG_REGS) {
+            gen_pop(target, arg_regs[i]);
+        } else {
+            gen_pop(target, "$t1");
+            fprintf(target->out, "sw     $t1, %d($sp)\n",
+                    (i - NUM_ARG_REGS + 1) * 4);
+        }
+    }
+}
+
+void gen_func_call(Node* n, Scope* s, Target* target)
+{
+    if (!strcmp(n->token_str, "output") || !strcmp(n->token_str, "input")) {
+        // The builtins take their single argument, if any, in $a0
+        if (n->child[0] != NULL) {
+            cgen_expr(n->child[0], s, target);
+        }
+
+        // A jal would overwrite the $ra that a function without a frame
+        // has not saved, so the syscall is made in place
+        if (!get_func(&s)->frameless) {
+            fprintf(target->out, "jal    %s\n", n->token_str);
+        } else if (!strcmp(n->token_str, "input")) {
+            gen_input_syscall(target);
+        } else {
+            gen_output_syscall(target);
+        }
+        return;
+    }
+
+    Symbol* callee = get_sym(&s, n->token_str);
+    gen_pass_args(n->child[0], s, target);
 
     fprintf(target->out, "jal    %s\n", n->token_str);
+
+    // Results come back in $v0, or in $a0 in a whole program
+    // (gen_return_value)
+    if ((callee->type != TYPE_VOID) && !options.whole_program) {
+        fprintf(target->out, "move   $a0, $v0\n");
+    }
+}
+
+/**
+ * Replace the current frame with the callee's. Its stack arguments
+ * overwrite our incoming ones, which is_tail_call checks there is room
+ * for, so that it returns to our caller with our $ra. Every argument is
+ * evaluated before any parameter is overwritten. A call to ourselves skips
+ * the prologue, as the frame is already in place.
+ */
+void gen_tail_call(Node* n, Scope* s, Target* target)
+{
+    Symbol* func = get_func(&s);
+    Symbol* callee = get_sym(&s, n->token_str);
+
+    // The first argument is in the last temporary
+    int last = target->depth + callee->len - 1;
+    gen_push_args(n->child[0], s, target);
+
+    for (int i = NUM_ARG_REGS; i < callee->len; ++i) {
+        fprintf(target->out, "lw     $t1, %d($sp)\n",
+                temp_offset(target, last - i));
+        fprintf(target->out, "sw     $t1, %d($fp)\n",
+                (i - NUM_ARG_REGS + 1) * 4);
+    }
+    for (int i = 0; i < num_reg_params(callee); ++i) {
+        fprintf(target->out, "lw     %s, %d($sp)\n", arg_regs[i],
+                temp_offset(target, last - i));
+    }
+    target->depth -= callee->len;
+
+    if ((callee == func) && (func->early_exits == 0)) {
+        fprintf(target->out, "j      %s_entry\n", func->id);
+    } else {
+        gen_frame_pop(target);
+        fprintf(target->out, "j      %s\n", callee->id);
+    }
+}
+
+/**
+ * The body of an inlined call runs in the caller's frame, with the callee's
+ * parameters and locals renamed into it. Returns leave their value in $a0
+ * and jump to the end of the body, just as a call would.
+ */
+void gen_inline_call(Node* n, Scope* s, Target* target)
+{
+    int label = target->label_count++;
+    int outer = target->inline_exit;
+
+    target->inline_exit = label;
+    gen_count(n->child[1], target);
+    cgen_stmts(n->child[1]->child[1], s, target);
+    target->inline_exit = outer;
+
+    fprintf(target->out, "%s%d:\n", "inline_exit", label);
+}
+
+void gen_inline_return(Target* target)
+{
+    fprintf(target->out, "j      %s%d\n", "inline_exit", target->inline_exit);
 }
 
 void gen_return(Node* n, Scope* s, Target* target)
@@ -59,213 +438,747 @@ void gen_return(Node* n, Scope* s, Target* target)
 
 void gen_return_exit(Node* n, Symbol* s, Target* target)
 {
-    fprintf(target->out, "j      %s_exit\n", s->id);
+    fprintf(target->out, "j      %s_%s\n", s->id,
+            target->unframed ? "early_exit" : "exit");
 }
 
-void gen_funcdef_entry(Node* n, Symbol* sym, Target* target)
+/**
+ * The frame is allocated all at once, with $ra and the caller's $fp saved
+ * at its top, where $fp then points. Without a frame pointer, $fp is left
+ * alone and its slot unused, so that the frame is laid out the same.
+ *
+ * The early exits of a shrink-wrapped function come first, and the frame
+ * is only allocated ahead of them when they need room for temporaries.
+ * They leave the first parameter in the first leaf register.
+ */
+void gen_funcdef_entry(Node* n, Scope* s, FILE* early, Target* target)
 {
+    Symbol* sym = get_func(&s);
     if (target->in_code == false) {
         fprintf(target->out, ".text\n");
         target->in_code = true;
     }
 
+    int size = frame_size(sym, target);
+    bool wrapped = sym->early_exits > 0;
+    bool early_frame = wrapped && (target->early_depth > 0);
     fprintf(target->out, "\n%s:\n", n->token_str);
-    fprintf(target->out, "move   $fp, $sp\n");
-    fprintf(target->out, "sw     $ra, 0($sp)\n");
-    fprintf(target->out, "addiu  $sp, $sp, -4\n");
+    if (!wrapped || early_frame) {
+        fprintf(target->out, "addiu  $sp, $sp, %d\n", -size);
+    }
+    if (wrapped) {
+        if (num_reg_params(sym) > 0) {
+            fprintf(target->out, "move   %s, $a0\n", leaf_regs[0]);
+        }
+        copy_stream(early, target);
+        if (!early_frame) {
+            fprintf(target->out, "addiu  $sp, $sp, %d\n", -size);
+        }
+    }
+    fprintf(target->out, "sw     $ra, %d($sp)\n", size);
+    if (!options.omit_fp) {
+        fprintf(target->out, "sw     $fp, %d($sp)\n", size - 4);
+        fprintf(target->out, "addiu  $fp, $sp, %d\n", size);
+    }
+    if (!wrapped) {
+        fprintf(target->out, "%s_entry:\n", n->token_str);
+    }
+
+    // Parameters passed in registers are kept below the saved registers,
+    // unless they were allocated registers of their own, which those
+    // passed on the stack are loaded into
+    int i = 0;
+    for (Node* p = n->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind == PARAM_VOID) {
+            break;
+        }
+        Symbol* param = get_sym(&s, p->token_str);
+        char* reg = (i >= NUM_ARG_REGS) ? NULL :
+                    (wrapped && (i == 0)) ? leaf_regs[0] : arg_regs[i];
+        int offset = options.omit_fp ? size + param->offset : param->offset;
+        char* base = options.omit_fp ? "$sp" : "$fp";
+        if ((reg == NULL) && (param->reg != NULL)) {
+            fprintf(target->out, "lw     %s, %d(%s)\n", param->reg, offset,
+                    base);
+        } else if (param->reg != NULL) {
+            fprintf(target->out, "move   %s, %s\n", param->reg, reg);
+        } else if (reg != NULL) {
+            fprintf(target->out, "sw     %s, %d(%s)\n", reg, offset, base);
+        }
+        i += 1;
+    }
+    fprintf(target->out, "\n");
+    if (!wrapped) {
+        copy_stream(early, target);
+    }
+}
+
+/**
+ * A leaf without a frame keeps its variables in registers, so on entry it
+ * only has to load its arguments from where the caller stored them, and
+ * make room for its temporaries.
+ */
+void gen_leaf_entry(Node* n, Scope* s, FILE* early, Target* target)
+{
+    if (target->in_code == false) {
+        fprintf(target->out, ".text\n");
+        target->in_code = true;
+    }
+
+    fprintf(target->out, "\n%s:\n", n->token_str);
+
+    int i = 0;
+    for (Node* p = n->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind == PARAM_VOID) {
+            break;
+        }
+        Symbol* param = get_sym(&s, p->token_str);
+        if (i >= NUM_ARG_REGS) {
+            fprintf(target->out, "lw     %s, %d($sp)\n", param->reg,
+                    (i - NUM_ARG_REGS + 1) * 4);
+        } else if (strcmp(param->reg, arg_regs[i])) {
+            fprintf(target->out, "move   %s, %s\n", param->reg, arg_regs[i]);
+        }
+        i += 1;
+    }
+
+    int size = frame_size(get_func(&s), target);
+    if (size > 0) {
+        fprintf(target->out, "addiu  $sp, $sp, %d\n", -size);
+    }
     fprintf(target->out, "\n");
+    copy_stream(early, target);
+}
+
+void gen_leaf_exit(Node* n, Symbol* sym, Target* target)
+{
+    fprintf(target->out, "%s_exit:\n", sym->id);
+    gen_return_value(sym, target);
+    int size = frame_size(sym, target);
+    if (size > 0) {
+        fprintf(target->out, "addiu  $sp, $sp, %d\n", size);
+    }
+    fprintf(target->out, "jr     $ra\n");
 }
 
 void gen_funcdef_exit(Node* n, Symbol* sym, Target* target)
 {
     fprintf(target->out, "%s_exit:\n", sym->id);
-    fprintf(target->out, "addiu  $sp, $sp, %d\n", sym->offset);
-    fprintf(target->out, "lw     $ra, 0($sp)\n");
-    fprintf(target->out, "addiu  $sp, $sp, %d\n", (sym->len + 1) * 4);
-    fprintf(target->out, "lw     $fp, 4($sp)\n");
+    gen_return_value(sym, target);
+    gen_frame_pop(target);
     fprintf(target->out, "jr     $ra\n");
+
+    if (sym->early_exits > 0) {
+        fprintf(target->out, "%s_early_exit:\n", sym->id);
+        gen_return_value(sym, target);
+        if (target->early_depth > 0) {
+            fprintf(target->out, "addiu  $sp, $sp, %d\n",
+                    frame_size(sym, target));
+        }
+        fprintf(target->out, "jr     $ra\n");
+    }
 }
 
+/**
+ * The arm laid out first falls through after the condition, which branches
+ * to the other arm, or to the end if there is none. An arm moved out of line
+ * is generated into `target->cold`, and follows the function's exit.
+ */
 void gen_if(Node* n, Scope* s, Target* target)
 {
-    cgen_expr(n->child[0], s, target);
-    fprintf(target->out, "bne    $a0, $zero, true_branch%d\n",
-            target->label_count);
-    fprintf(target->out, "%s%d:\n", "false_branch", target->label_count);
+    int label = target->label_count++;
+    Statement* stmt = n->element.stmt;
+    Node* first = stmt->else_first ? n->child[2] : n->child[1];
+    Node* second = stmt->else_first ? n->child[1] : n->child[2];
+    char* second_label = stmt->else_first ? "true_branch" : "false_branch";
 
-    if (n->child[2] != NULL) {
-        cgen_stmts(n->child[2], s, target);
+    cgen_cond(n->child[0], s, target, stmt->else_first,
+            (second != NULL) ? second_label : "end_if", label);
+    if (first != NULL) {
+        cgen_stmts(first, s, target);
     }
 
-    fprintf(target->out, "b      %s%d\n", "end_if", target->label_count);
-    fprintf(target->out, "%s%d:\n", "true_branch", target->label_count);
+    if (second == NULL) {
+        fprintf(target->out, "%s%d:\n", "end_if", label);
+        return;
+    }
 
-    cgen_stmts(n->child[1], s, target);
+    // Cold code is already out of line
+    if (stmt->out_of_line && (target->out != target->cold)) {
+        fprintf(target->out, "%s%d:\n", "end_if", label);
+        FILE* out = target->out;
+        target->out = gen_cold_stream(target);
+        fprintf(target->out, "%s%d:\n", second_label, label);
+        cgen_stmts(second, s, target);
+        if (can_complete(second)) {
+            fprintf(target->out, "b      %s%d\n", "end_if", label);
+        }
+        target->out = out;
+        return;
+    }
 
-    fprintf(target->out, "%s%d:\n", "end_if", target->label_count);
-    target->label_count += 1;
+    // Nothing to branch over if the first arm always returns
+    if (can_complete(first)) {
+        fprintf(target->out, "b      %s%d\n", "end_if", label);
+    }
+    fprintf(target->out, "%s%d:\n", second_label, label);
+
+    cgen_stmts(second, s, target);
+
+    fprintf(target->out, "%s%d:\n", "end_if", label);
 }
 
+/**
+ * Loops are rotated: a guard skips the loop if its condition fails on entry,
+ * and the condition is tested again at the bottom of the body, so each
+ * iteration takes one branch rather than two. The guard is left out when the
+ * condition is known to hold on entry.
+ */
 void gen_while(Node* n, Scope* s, Target* target)
 {
-    fprintf(target->out, "%s%d:\n", "while_start", target->label_count);
+    int label = target->label_count++;
 
+    if (!n->element.stmt->enters) {
+        cgen_cond(n->child[0], s, target, false, "while_end", label);
+    }
+    fprintf(target->out, "%s%d:\n", "while_body", label);
+
+    cgen_stmts(n->child[1], s, target);
+
+    if (can_complete(n->child[1])) {
+        cgen_cond(n->child[0], s, target, true, "while_body", label);
+    }
+    fprintf(target->out, "%s%d:\n", "while_end", label);
+}
+
+/**
+ * Branch on `$t1 op $a0`, the left operand being the last temporary.
+ */
+void gen_branch_cmp(Target* target, char* op, char* label, int num)
+{
+    char* branch = NULL;
+    if (!strcmp(op, "<")) {
+        branch = "blt";
+    } else if (!strcmp(op, "<=")) {
+        branch = "ble";
+    } else if (!strcmp(op, ">")) {
+        branch = "bgt";
+    } else if (!strcmp(op, ">=")) {
+        branch = "bge";
+    } else if (!strcmp(op, "==")) {
+        branch = "beq";
+    } else if (!strcmp(op, "!=")) {
+        branch = "bne";
+    } else {
+        printf("Error: gen_branch_cmp()\n");
+        exit(GENERATOR_ERROR);
+    }
+
+    gen_pop(target, "$t1");
+    fprintf(target->out, "%s    $t1, $a0, %s%d\n", branch, label, num);
+}
+
+/**
+ * Branch on `$a0 op 0`.
+ */
+void gen_branch_zero(Target* target, char* op, char* label, int num)
+{
+    if (!strcmp(op, "<")) {
+        fprintf(target->out, "bltz   $a0, %s%d\n", label, num);
+    } else if (!strcmp(op, "<=")) {
+        fprintf(target->out, "blez   $a0, %s%d\n", label, num);
+    } else if (!strcmp(op, ">")) {
+        fprintf(target->out, "bgtz   $a0, %s%d\n", label, num);
+    } else if (!strcmp(op, ">=")) {
+        fprintf(target->out, "bgez   $a0, %s%d\n", label, num);
+    } else if (!strcmp(op, "==")) {
+        fprintf(target->out, "beq    $a0, $zero, %s%d\n", label, num);
+    } else if (!strcmp(op, "!=")) {
+        fprintf(target->out, "bne    $a0, $zero, %s%d\n", label, num);
+    } else {
+        printf("Error: gen_branch_zero()\n");
+        exit(GENERATOR_ERROR);
+    }
+}
+
+void gen_branch(Target* target, char* label, int num)
+{
+    fprintf(target->out, "b      %s%d\n", label, num);
+}
+
+/**
+ * True if the global is small enough to be placed in the small data area,
+ * where spim addresses it from $gp in one instruction rather than building
+ * its address in $t8 first.
+ */
+bool is_small_data(Symbol* var)
+{
+    int size = (var->cat == CAT_VAR_ARR) ? var->len * 4 : 4;
+    return !var->local && (size <= options.small_data);
+}
+
+/**
+ * The address of an array element, computed as for an access to it.
+ */
+void gen_address(Node* n, Symbol* var, Scope* s, Target* target)
+{
     cgen_expr(n->child[0], s, target);
 
-    fprintf(target->out, "beq    $a0, $zero, while_end%d\n", target->label_count);
+    fprintf(target->out, "li     $t9, 4\n");
+    fprintf(target->out, "mul    $a0, $a0, $t9\n");
+    if (var->local == false) {
+        fprintf(target->out, "la     $t8, %s\n", var->id);
+        fprintf(target->out, "add    $a0, $t8, $a0\n");
+    } else {
+        fprintf(target->out, "move   $t8, $fp\n");
+        fprintf(target->out, "addiu  $t8, $t8, %d\n", var->offset);
+        fprintf(target->out, "sub    $a0, $t8, $a0\n");
+    }
+}
+
+/**
+ * The register holding a pointer's value, loading it into $t8 if it lives in
+ * the frame.
+ */
+char* gen_pointer(Symbol* var, Target* target)
+{
+    if (var->reg != NULL) {
+        return var->reg;
+    }
+    fprintf(target->out, "lw     $t8, %d($fp)\n", var->offset);
+    return "$t8";
+}
+
+void gen_var(Node* n, Scope* s, Target* target)
+{
+    Symbol* var = get_sym(&s, n->token_str);
+
+    // Locals are accessed relative to the $fp, globals are accessed 
+    // relative to the variable's global address. The index is evaluated
+    // before the base is loaded into $t8, as it may itself use $t8.
+    if (n->element.var->variable_kind == VAR_ADDRESS) {
+        gen_address(n, var, s, target);
+    } else if (is_deref(n)) {
+        fprintf(target->out, "lw     $a0, %d(%s)\n", n->element.var->offset,
+                gen_pointer(var, target));
+    } else if (var->reg != NULL) {
+        fprintf(target->out, "move   $a0, %s\n", var->reg);
+    } else if (var->local == false) {
+        if ((var->cat == CAT_VAR_SIN) && is_small_data(var)) {
+            fprintf(target->out, "lw     $a0, %s\n", var->id);
+        } else if (var->cat == CAT_VAR_SIN) {
+            fprintf(target->out, "la     $t8, %s\n", var->id);
+            fprintf(target->out, "lw     $a0, 0($t8)\n");
+        } else {
+            cgen_expr(n->child[0], s, target);
+
+            fprintf(target->out, "li     $t9, 4\n");
+            fprintf(target->out, "mul    $a0, $a0, $t9\n");
+            fprintf(target->out, "la     $t8, %s\n", var->id);
+            fprintf(target->out, "add    $t8, $t8, $a0\n");
+            fprintf(target->out, "lw     $a0, 0($t8)\n");
+        }
+    } else {
+        if (var->cat == CAT_VAR_SIN) {
+            fprintf(target->out, "lw     $a0, %d($fp)\n", var->offset);
+        } else {
+            cgen_expr(n->child[0], s, target);
+
+            fprintf(target->out, "li     $t9, 4\n");
+            fprintf(target->out, "mul    $a0, $a0, $t9\n");
+            fprintf(target->out, "move   $t8, $fp\n");
+            fprintf(target->out, "addiu  $t8, $t8, %d\n", var->offset);
+            fprintf(target->out, "sub    $t8, $t8, $a0\n");
+            fprintf(target->out, "lw     $a0, 0($t8)\n");
+        }
+    }
+}
+
+void gen_assign(Node* n, Scope* s, Target* target)
+{
+    n = n->child[0];
+
+    Symbol* var = get_sym(&s, n->token_str);
+    if (is_deref(n)) {
+        fprintf(target->out, "sw     $a0, %d(%s)\n", n->element.var->offset,
+                gen_pointer(var, target));
+        return;
+    }
+    if (var->reg != NULL) {
+        fprintf(target->out, "move   %s, $a0\n", var->reg);
+        return;
+    }
+
+    if (var->cat == CAT_VAR_SIN) {
+        if (var->local) {
+            fprintf(target->out, "sw     $a0, %d($fp)\n", var->offset);
+        } else if (is_small_data(var)) {
+            fprintf(target->out, "sw     $a0, %s\n", var->id);
+        } else {
+            fprintf(target->out, "la     $t8, %s\n", var->id);
+            fprintf(target->out, "sw     $a0, %s($t8)\n", "0");
+        }
+        return;
+    }
+
+    // The value is kept in a temporary while an array index is evaluated
+    gen_push(target, "$a0");
+
+    cgen_expr(n->child[0], s, target);
+
+    fprintf(target->out, "li     $t9, 4\n");
+    fprintf(target->out, "mul    $a0, $a0, $t9\n");
+    if (var->local == false) {
+        fprintf(target->out, "la     $t8, %s\n", var->id);
+        fprintf(target->out, "add    $t8, $t8, $a0\n");
+    } else {
+        fprintf(target->out, "move   $t8, $fp\n");
+        fprintf(target->out, "addiu  $t8, $t8, %d\n", var->offset);
+        fprintf(target->out, "sub    $t8, $t8, $a0\n");
+    }
+    gen_pop(target, "$a0");
+    fprintf(target->out, "sw     $a0, 0($t8)\n");
+}
+
+void gen_num(Node* n, Target* target)
+{
+    int num = atoi(n->token_str);
+    fprintf(target->out, "li     $a0, %d\n", num);
+}
+
+/**
+ * Division and the relational operators other than `<` are pseudo-ops that
+ * spim may expand into code containing branches, whose delay slots the
+ * scheduler can't see. Spell them out in real instructions instead, and
+ * return false for the operators that are real instructions already. The
+ * real div doesn't check its divisor, so a teq traps on zero as the pseudo-op
+ * would.
+ */
+bool gen_branch_free_e2(Target* target, char* op)
+{
+    if (!strcmp(op, "*") || !strcmp(op, "+") || !strcmp(op, "-") ||
+            !strcmp(op, "<")) {
+        return false;
+    }
+
+    gen_pop(target, "$t1");
+    if (!strcmp(op, "/")) {
+        fprintf(target->out, "teq    $a0, $zero\n");
+        fprintf(target->out, "div    $t1, $a0\n");
+        fprintf(target->out, "mflo   $a0\n");
+    } else if (!strcmp(op, "<=")) {
+        fprintf(target->out, "slt    $a0, $a0, $t1\n");
+        fprintf(target->out, "xori   $a0, $a0, 1\n");
+    } else if (!strcmp(op, ">")) {
+        fprintf(target->out, "slt    $a0, $a0, $t1\n");
+    } else if (!strcmp(op, ">=")) {
+        fprintf(target->out, "slt    $a0, $t1, $a0\n");
+        fprintf(target->out, "xori   $a0, $a0, 1\n");
+    } else if (!strcmp(op, "==")) {
+        fprintf(target->out, "xor    $a0, $t1, $a0\n");
+        fprintf(target->out, "sltiu  $a0, $a0, 1\n");
+    } else if (!strcmp(op, "!=")) {
+        fprintf(target->out, "xor    $a0, $t1, $a0\n");
+        fprintf(target->out, "sltu   $a0, $zero, $a0\n");
+    } else {
+        printf("Error: gen_branch_free_e2()\n");
+        exit(GENERATOR_ERROR);
+    }
+    return true;
+}
+
+void gen_addit_e2(Node* n, Target* target, char* op)
+{
+    if (options.delay_slots && gen_branch_free_e2(target, op)) {
+        return;
+    }
+
+    char* operation = NULL;
+    if (!strcmp(op, "*")) {
+        operation = "mul";
+    } else if (!strcmp(op, "/")) {
+        operation = "div";
+    } else if (!strcmp(op, "+")) {
+        operation = "add";
+    } else if (!strcmp(op, "-")) {
+        operation = "sub";
+    } else if (!strcmp(op, "<")) {
+        operation = "slt";
+    } else if (!strcmp(op, "<=")) {
+        operation = "sle";
+    } else if (!strcmp(op, ">")) {
+        operation = "sgt";
+    } else if (!strcmp(op, ">=")) {
+        operation = "sge";
+    } else if (!strcmp(op, "==")) {
+        operation = "seq";
+    } else if (!strcmp(op, "!=")) {
+        operation = "sne";
+    } else {
+        printf("Error: gen_addit_e2()\n");
+        exit(GENERATOR_ERROR);
+    }
+
+    gen_pop(target, "$t1");
+    fprintf(target->out, "%-6s $a0, $t1, $a0\n", operation);
+}
+
+bool fits_imm(int num)
+{
+    return (num >= -32768) && (num <= 32767);
+}
+
+/**
+ * Add the constant operand to $a0 in place, for `e + c`, `c + e` and
+ * `e - c`, rather than pushing e and loading c. This is addi, which traps
+ * on overflow as add and sub do. Returns false if the operand isn't a
+ * constant that fits in an immediate.
+ */
+bool gen_add_imm(Node* n, Node* constant, Target* target)
+{
+    if ((constant->kind != NODE_FACTOR) || (strcmp(n->token_str, "+") &&
+                ((constant != n->child[1]) || strcmp(n->token_str, "-")))) {
+        return false;
+    }
+
+    int num = atoi(constant->token_str);
+    if (!strcmp(n->token_str, "-")) {
+        num = -num;
+    }
+    if (!fits_imm(num)) {
+        return false;
+    }
+
+    fprintf(target->out, "addi   $a0, $a0, %d\n", num);
+    return true;
+}
+
+/**
+ * The multiplier and shift that divide by `d`, where |d| >= 2, from
+ * Warren's Hacker's Delight, section 10-4. Taking the high word of the
+ * product with the multiplier and shifting it right gives the quotient,
+ * short by one when it is negative.
+ */
+void find_magic(int d, int* magic, int* shift)
+{
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = (d < 0) ? 0u - (uint32_t) d : (uint32_t) d;
+    uint32_t t = two31 + ((uint32_t) d >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    uint32_t q1 = two31 / anc;
+    uint32_t r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad;
+    uint32_t r2 = two31 - q2 * ad;
+    uint32_t delta = 0;
+    int p = 31;
 
-    cgen_stmts(n->child[1], s, target);
+    do {
+        p += 1;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1 += 1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2 += 1;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while ((q1 < delta) || ((q1 == delta) && (r1 == 0)));
 
-    fprintf(target->out, "b      %s%d\n", "while_start", target->label_count);
-    fprintf(target->out, "%s%d:\n", "while_end", target->label_count);
+    uint32_t m = q2 + 1;
+    *magic = (int) ((d < 0) ? 0u - m : m);
+    *shift = p - 32;
+}
 
-    target->label_count += 1;
+void gen_shift_left(Target* target, char* reg, int shift)
+{
+    if (shift > 0) {
+        fprintf(target->out, "sll    %s, %s, %d\n", reg, reg, shift);
+    }
 }
 
-void gen_var(Node* n, Scope* s, Target* target)
+int log_2(unsigned int n)
 {
-    Symbol* var = get_sym(&s, n->token_str);
+    int log = 0;
+    while (n > 1) {
+        n >>= 1;
+        log += 1;
+    }
+    return log;
+}
 
-    // Locals are accessed relative to the $fp, globals are accessed 
-    // relative to the variable's global address.
-    if (var->local == false) {
-        if (var->cat == CAT_VAR_SIN) {
-            fprintf(target->out, "la     $t8, %s\n", var->id);
-            fprintf(target->out, "lw     $a0, 0($t8)\n");
-        } else {
-            fprintf(target->out, "la     $t8, %s\n", var->id);
+/**
+ * Multiply $a0 in place by the constant operand of `e * c` or `c * e`,
+ * with shifts and adds where the sum or difference of two powers of two
+ * makes up the constant. Returns false if the operand isn't a constant.
+ */
+bool gen_mul_imm(Node* n, Node* constant, Target* target)
+{
+    if ((constant->kind != NODE_FACTOR) || strcmp(n->token_str, "*")) {
+        return false;
+    }
 
-            cgen_expr(n->child[0], s, target);
+    int num = atoi(constant->token_str);
+    unsigned int size = (num < 0) ? -(unsigned int) num : (unsigned int) num;
+    int high = log_2(size);
+    unsigned int rest = size - (1u << high);
+    unsigned int fill = (2u << high) - size;
 
-            fprintf(target->out, "li     $t9, 4\n");
-            fprintf(target->out, "mul    $a0, $a0, $t9\n");
-            fprintf(target->out, "add    $t8, $t8, $a0\n");
-            fprintf(target->out, "lw     $a0, 0($t8)\n");
-        }
+    if (size == 0) {
+        fprintf(target->out, "move   $a0, $zero\n");
+        return true;
+    } else if (rest == 0) {
+        gen_shift_left(target, "$a0", high);
+    } else if ((rest & (rest - 1)) == 0) {
+        // 2^a + 2^b
+        fprintf(target->out, "sll    $t8, $a0, %d\n", high);
+        gen_shift_left(target, "$a0", log_2(rest));
+        fprintf(target->out, "addu   $a0, $t8, $a0\n");
+    } else if (((fill & (fill - 1)) == 0) && (high < 31)) {
+        // 2^(a + 1) - 2^b
+        fprintf(target->out, "sll    $t8, $a0, %d\n", high + 1);
+        gen_shift_left(target, "$a0", log_2(fill));
+        fprintf(target->out, "subu   $a0, $t8, $a0\n");
     } else {
-        if (var->cat == CAT_VAR_SIN) {
-            fprintf(target->out, "lw     $a0, %d($fp)\n", var->offset);
-        } else {
-            fprintf(target->out, "move   $t8, $fp\n");
-            fprintf(target->out, "addiu  $t8, $t8, %d\n", var->offset);
-
-            cgen_expr(n->child[0], s, target);
+        fprintf(target->out, "li     $t8, %d\n", num);
+        fprintf(target->out, "mul    $a0, $a0, $t8\n");
+        return true;
+    }
 
-            fprintf(target->out, "li     $t9, 4\n");
-            fprintf(target->out, "mul    $a0, $a0, $t9\n");
-            fprintf(target->out, "sub    $t8, $t8, $a0\n");
-            fprintf(target->out, "lw     $a0, 0($t8)\n");
-        }
+    if (num < 0) {
+        fprintf(target->out, "subu   $a0, $zero, $a0\n");
     }
+    return true;
 }
 
-void gen_assign(Node* n, Scope* s, Target* target)
+/**
+ * Divide $a0 in place by the constant operand of `e / c`, rounding towards
+ * zero as div does. A power of two is a shift, after adding one less than
+ * the divisor to a negative dividend; anything else multiplies by a magic
+ * number and keeps the high word. Returns false if the divisor isn't a
+ * non-zero constant, leaving division by zero to fail at run time.
+ */
+bool gen_div_imm(Node* n, Target* target)
 {
-    fprintf(target->out, "sw     $a0, 0($sp)\n");
-    fprintf(target->out, "addiu  $sp, $sp, -4\n");
-
-    n = n->child[0];
-
-    Symbol* var = get_sym(&s, n->token_str);
-    if (var->local == false) {
-        if (var->cat == CAT_VAR_SIN) {
-            fprintf(target->out, "la     $t8, %s\n", var->id);
-            fprintf(target->out, "sw     $a0, %s($t8)\n", "0");
-        } else {
-            fprintf(target->out, "la     $t8, %s\n", var->id);
+    if ((n->child[1]->kind != NODE_FACTOR) || strcmp(n->token_str, "/")) {
+        return false;
+    }
 
-            cgen_expr(n->child[0], s, target);
+    int num = atoi(n->child[1]->token_str);
+    unsigned int size = (num < 0) ? -(unsigned int) num : (unsigned int) num;
+    if (size == 0) {
+        return false;
+    }
 
-            fprintf(target->out, "li     $t9, 4\n");
-            fprintf(target->out, "mul    $a0, $a0, $t9\n");
-            fprintf(target->out, "add    $t8, $t8, $a0\n");
-            fprintf(target->out, "lw     $a0, 4($sp)\n");
-            fprintf(target->out, "addiu  $sp, $sp, 4\n");
-            fprintf(target->out, "sw     $a0, 0($t8)\n");
+    if ((size & (size - 1)) == 0) {
+        int shift = log_2(size);
+        if (shift > 0) {
+            fprintf(target->out, "sra    $t8, $a0, 31\n");
+            fprintf(target->out, "srl    $t8, $t8, %d\n", 32 - shift);
+            fprintf(target->out, "addu   $a0, $a0, $t8\n");
+            fprintf(target->out, "sra    $a0, $a0, %d\n", shift);
         }
-    } else {
-        if (var->cat == CAT_VAR_SIN) {
-            fprintf(target->out, "sw     $a0, %d($fp)\n", var->offset);
-        } else {
-            fprintf(target->out, "move   $t8, $fp\n");
-            fprintf(target->out, "addiu  $t8, $t8, %d\n", var->offset);
-
-            cgen_expr(n->child[0], s, target);
-
-            fprintf(target->out, "li     $t9, 4\n");
-            fprintf(target->out, "mul    $a0, $a0, $t9\n");
-            fprintf(target->out, "sub    $t8, $t8, $a0\n");
-            fprintf(target->out, "lw     $a0, 4($sp)\n");
-            fprintf(target->out, "addiu  $sp, $sp, 4\n");
-            fprintf(target->out, "sw     $a0, 0($t8)\n");
+        if (num < 0) {
+            fprintf(target->out, "subu   $a0, $zero, $a0\n");
         }
+        return true;
+    }
+
+    int magic = 0;
+    int shift = 0;
+    find_magic(num, &magic, &shift);
+    fprintf(target->out, "li     $t8, %d\n", magic);
+    fprintf(target->out, "mult   $a0, $t8\n");
+    fprintf(target->out, "mfhi   $t8\n");
+    if ((num > 0) && (magic < 0)) {
+        fprintf(target->out, "addu   $t8, $t8, $a0\n");
+    } else if ((num < 0) && (magic > 0)) {
+        fprintf(target->out, "subu   $t8, $t8, $a0\n");
+    }
+    if (shift > 0) {
+        fprintf(target->out, "sra    $t8, $t8, %d\n", shift);
     }
-    fprintf(target->out, "addiu  $sp, $sp, 4\n");
+    // Round a negative quotient up, towards zero
+    fprintf(target->out, "srl    $t9, $t8, 31\n");
+    fprintf(target->out, "addu   $a0, $t8, $t9\n");
+    return true;
 }
 
-void gen_num(Node* n, Target* target)
+/**
+ * True if `$a0 op num` can be computed with the constant as an immediate.
+ * `<=` and `>` compare against one more, and `==` and `!=` subtract it.
+ */
+bool fits_relop_imm(char* op, int num)
 {
-    int num = atoi(n->token_str);
-    fprintf(target->out, "li     $a0, %d\n", num);
+    if (!strcmp(op, "<") || !strcmp(op, ">=")) {
+        return fits_imm(num);
+    } else if (!strcmp(op, "<=") || !strcmp(op, ">")) {
+        return num < 32767;
+    }
+    return num > -32768;
 }
 
-void gen_addit_e2(Node* n, Target* target, char* op)
+/**
+ * Set $a0 in place to the truth of `$a0 op num`, for a constant that
+ * fits_relop_imm, rather than pushing $a0 and loading the constant.
+ */
+void gen_relop_imm(Target* target, char* op, int num)
 {
-    char* operation = NULL;
-    switch (*op) {
-        case '*':
-            operation = "mul";
-            break;
-        case '/':
-            operation = "div";
-            break;
-        case '+':
-            operation = "add";
-            break;
-        case '-':
-            operation = "sub";
-            break;
-        case '<':
-            operation = "slt";
-            break;
-        case '>':
-            operation = "sgt";
-            break;
-        case '=':
-            operation = "seq";
-            break;
-        default:
-            printf("Error: gen_global_var()\n");
-            exit(GENERATOR_ERROR);
+    if (!strcmp(op, "<")) {
+        fprintf(target->out, "slti   $a0, $a0, %d\n", num);
+    } else if (!strcmp(op, "<=")) {
+        fprintf(target->out, "slti   $a0, $a0, %d\n", num + 1);
+    } else if (!strcmp(op, ">")) {
+        fprintf(target->out, "slti   $a0, $a0, %d\n", num + 1);
+        fprintf(target->out, "xori   $a0, $a0, 1\n");
+    } else if (!strcmp(op, ">=")) {
+        fprintf(target->out, "slti   $a0, $a0, %d\n", num);
+        fprintf(target->out, "xori   $a0, $a0, 1\n");
+    } else if (!strcmp(op, "==") || !strcmp(op, "!=")) {
+        if (num != 0) {
+            fprintf(target->out, "addiu  $a0, $a0, %d\n", -num);
+        }
+        if (!strcmp(op, "==")) {
+            fprintf(target->out, "sltiu  $a0, $a0, 1\n");
+        } else {
+            fprintf(target->out, "sltu   $a0, $zero, $a0\n");
+        }
+    } else {
+        printf("Error: gen_relop_imm()\n");
+        exit(GENERATOR_ERROR);
     }
-
-    fprintf(target->out, "lw     $t1, 4($sp)\n");
-    fprintf(target->out, "%s    $a0, $t1, $a0\n", operation);
-    fprintf(target->out, "addiu  $sp, $sp, 4\n");
 }
 
-void gen_addit_e1(Node* n, Target* target)
+/**
+ * Branch on `$a0 op num`, for a constant that fits_relop_imm.
+ */
+void gen_branch_imm(Target* target, char* op, int num, char* label,
+        int label_num)
 {
-    fprintf(target->out, "sw     $a0, 0($sp)\n");
-    fprintf(target->out, "addiu  $sp, $sp, -4\n");
+    if (!strcmp(op, "==") || !strcmp(op, "!=")) {
+        fprintf(target->out, "li     $t8, %d\n", num);
+        fprintf(target->out, "%s    $a0, $t8, %s%d\n",
+                strcmp(op, "==") ? "bne" : "beq", label, label_num);
+        return;
+    }
+
+    bool below = !strcmp(op, "<") || !strcmp(op, "<=");
+    int bound = (!strcmp(op, "<=") || !strcmp(op, ">")) ? num + 1 : num;
+    fprintf(target->out, "slti   $t8, $a0, %d\n", bound);
+    fprintf(target->out, "%s    $t8, $zero, %s%d\n", below ? "bne" : "beq",
+            label, label_num);
 }
 
-void gen_func_locals(Node* n, Symbol* sym, Target* target)
+void gen_addit_e1(Node* n, Target* target)
 {
-    switch (sym->cat) {
-        case CAT_VAR_SIN:
-            fprintf(target->out, "addiu  $sp, $sp, -4\n");
-            break;
-        case CAT_VAR_ARR:
-            fprintf(target->out, "addiu  $sp, $sp, -%d\n", sym->len * 4);
-            break;
-        default:
-            printf("Error: gen_global_var()\n");
-            exit(GENERATOR_ERROR);
-    }
+    gen_push(target, "$a0");
 }
 
-void gen_main_entry(Node* n, Symbol* sym, Target* target)
+void gen_main_entry(Node* n, Symbol* sym, FILE* early, Target* target)
 {
     if (target->in_code == false) {
         fprintf(target->out, ".text\n");
@@ -274,16 +1187,25 @@ void gen_main_entry(Node* n, Symbol* sym, Target* target)
     gen_input_function(target);
     gen_output_function(target);
 
+    // There is no caller's $fp to save, but its slot is kept for the
+    // locals to be laid out as in any other function
+    int size = frame_size(sym, target);
     fprintf(target->out, "\n.globl main\n%s:\n", n->token_str);
-    fprintf(target->out, "move   $fp, $sp\n");
-    fprintf(target->out, "sw     $ra, 0($sp)\n");
-    fprintf(target->out, "addiu  $sp, $sp, -4\n");
+    fprintf(target->out, "addiu  $sp, $sp, %d\n", -size);
+    fprintf(target->out, "sw     $ra, %d($sp)\n", size);
+    if (!options.omit_fp) {
+        fprintf(target->out, "addiu  $fp, $sp, %d\n", size);
+    }
     fprintf(target->out, "\n");
+    copy_stream(early, target);
 }
 
 void gen_main_exit(Node* n, Symbol* sym, Target* target)
 {
     fprintf(target->out, "\nmain_exit:\n");
+    if (options.profile_generate) {
+        gen_profile_dump(target);
+    }
     fprintf(target->out, "li     $v0, 10\n");
     fprintf(target->out, "syscall\n");
 }
@@ -295,6 +1217,13 @@ void gen_global_var(Node* n, Symbol* sym, Target* target)
         target->in_code = false;
     }
 
+    // spim moves a global declared .extern into the small data area around
+    // $gp, ignoring the definition that follows; other assemblers keep it
+    if (is_small_data(sym)) {
+        fprintf(target->out, ".extern %s %d\n", sym->id,
+                (sym->cat == CAT_VAR_ARR) ? sym->len * 4 : 4);
+    }
+
     switch (sym->cat) {
         case CAT_VAR_SIN:
             fprintf(target->out, "%s: .word 0:1\n", sym->id);
@@ -332,8 +1261,8 @@ int count_params(Node* n)
  */
 int count_local_space(Node* n)
 {
-    // Start with 4 as the $ra is already on the stack
-    int total = 4;
+    // Start with 8 for $ra and the caller's $fp, saved above the locals
+    int total = 8;
     while (n != NULL) {
         Variable* var = n->element.decl->var;
         total += var->variable_kind == VAR_SINGLE ? 4 : var->arr_len * 4;
@@ -341,3 +1270,401 @@ int count_local_space(Node* n)
     }
     return total;
 }
+
+/**
+ * The most arguments that any call in `n` passes on the stack, which the
+ * frame's outgoing argument area must have room for.
+ */
+int count_out_args(Node* n)
+{
+    int most = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE)) {
+            int args = 0;
+            for (Node* arg = n->child[0]; arg != NULL; arg = arg->sibling) {
+                args += 1;
+            }
+            most = (args - NUM_ARG_REGS > most) ? args - NUM_ARG_REGS : most;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            int inner = count_out_args(n->child[i]);
+            most = (inner > most) ? inner : most;
+        }
+    }
+    return most;
+}
+
+/**
+ * A leaf function whose variables all fit in the free registers is compiled
+ * without a frame: $ra is never overwritten, so it need not be saved, nor
+ * need $fp. Its second to fourth parameters stay in the registers they were
+ * passed in.
+ */
+bool is_frameless(Node* n)
+{
+    if (!strcmp(n->token_str, "main") || has_array_param(n) ||
+            has_calls(n->child[1])) {
+        return false;
+    }
+
+    int params = count_params(n->child[0]);
+    int vars = params;
+    for (Node* dec = n->child[1]->child[0]; dec != NULL; dec = dec->sibling) {
+        if (dec->element.decl->var->variable_kind == VAR_ARRAY) {
+            return false;
+        }
+        vars += 1;
+    }
+
+    int kept = params < NUM_ARG_REGS ? params : NUM_ARG_REGS;
+    if (kept > 0) {
+        // The first is moved out of $a0, which holds intermediate results
+        kept -= 1;
+    }
+    return vars - kept <= num_leaf_regs();
+}
+
+/**
+ * Leading statements of a function's body that can be tested before its
+ * frame is set up, shrink-wrapping it. Each is an if with an arm that exits
+ * without reading a local or calling anything (early_exit_arm), and the
+ * last may have another arm, which the rest of the body then follows. A
+ * fast path out through them never saves $ra or $fp.
+ */
+int count_early_exits(Node* n)
+{
+    if (!strcmp(n->token_str, "main") || is_frameless(n)) {
+        return 0;
+    }
+
+    int count = 0;
+    for (Node* stmt = n->child[1]->child[1];
+            (stmt != NULL) && (early_exit_arm(n, stmt) != NULL);
+            stmt = stmt->sibling) {
+        count += 1;
+        if (other_arm(stmt, early_exit_arm(n, stmt)) != NULL) {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * Generate a function's early exits, with its parameters read from the
+ * registers they were passed in, and the first copied out of $a0 into the
+ * first leaf register, from where the frame's set-up then stores it. The
+ * exit arm falls through, unless the layout moved it out of line. Returns
+ * the statement after them, and the arm of the last to be generated before
+ * it in `arm`.
+ */
+Node* gen_early_exits(Node* n, Scope* s, Target* target, Node** arm)
+{
+    Symbol* func = get_func(&s);
+    Node* stmt = n->child[1]->child[1];
+    *arm = NULL;
+    if (func->early_exits == 0) {
+        return stmt;
+    }
+
+    char* regs[NUM_ARG_REGS] = {
+        leaf_regs[0], arg_regs[1], arg_regs[2], arg_regs[3]
+    };
+    swap_param_regs(n, s, regs);
+    target->unframed = true;
+    for (int i = 0; i < func->early_exits; ++i) {
+        Node* exit_arm = early_exit_arm(n, stmt);
+        bool on_true = exit_arm == stmt->child[1];
+        char* arm_label = on_true ? "true_branch" : "false_branch";
+        int label = target->label_count++;
+
+        gen_count(stmt, target);
+        if (stmt->element.stmt->out_of_line &&
+                (stmt->element.stmt->else_first == on_true)) {
+            cgen_cond(stmt->child[0], s, target, on_true, arm_label, label);
+            FILE* out = target->out;
+            target->out = gen_cold_stream(target);
+            fprintf(target->out, "%s%d:\n", arm_label, label);
+            cgen_stmts(exit_arm, s, target);
+            target->out = out;
+        } else {
+            cgen_cond(stmt->child[0], s, target, !on_true, "end_if", label);
+            cgen_stmts(exit_arm, s, target);
+            fprintf(target->out, "%s%d:\n", "end_if", label);
+        }
+
+        *arm = other_arm(stmt, exit_arm);
+        stmt = stmt->sibling;
+    }
+    target->unframed = false;
+    swap_param_regs(n, s, regs);
+
+    return stmt;
+}
+
+/**
+ * The arm of an if that returns, doing nothing on the way that needs the
+ * frame, or NULL if it doesn't have one.
+ */
+static Node* early_exit_arm(Node* func, Node* stmt)
+{
+    if ((stmt->kind != NODE_STMT) ||
+            (stmt->element.stmt->statement_kind != STMT_IF) ||
+            !is_frame_free(func, stmt->child[0])) {
+        return NULL;
+    }
+
+    for (int i = 1; i <= 2; ++i) {
+        Node* arm = stmt->child[i];
+        Node* stmts = ((arm != NULL) && (arm->kind == NODE_CSTMT) &&
+                       (arm->child[0] == NULL)) ? arm->child[1] : arm;
+        for (Node* s = stmts; s != NULL; s = s->sibling) {
+            if ((s->kind != NODE_STMT) || !is_frame_free(func, s->child[0])) {
+                break;
+            }
+            if (s->element.stmt->statement_kind == STMT_RETURN) {
+                if (s->sibling == NULL) {
+                    return arm;
+                }
+                break;
+            }
+            if (s->element.stmt->statement_kind != STMT_EXPR) {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static Node* other_arm(Node* stmt, Node* arm)
+{
+    return (arm == stmt->child[1]) ? stmt->child[2] : stmt->child[1];
+}
+
+/**
+ * True if the expression can be evaluated without the function's frame,
+ * reading nothing but globals and the parameters passed in registers.
+ */
+static bool is_frame_free(Node* func, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CALL) {
+            return false;
+        }
+        if (n->kind == NODE_VAR) {
+            int i = param_index(func, n->token_str);
+            if (is_deref(n) ||
+                    (n->element.var->variable_kind == VAR_ADDRESS) ||
+                    ((i < 0) && declares(func, n->token_str)) ||
+                    (i >= NUM_ARG_REGS) ||
+                    ((i >= 0) && (n->child[0] != NULL))) {
+                return false;
+            }
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (!is_frame_free(func, n->child[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Position of a parameter, or -1 if `id` isn't one.
+ */
+static int param_index(Node* func, char* id)
+{
+    int i = 0;
+    for (Node* p = func->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind == PARAM_VOID) {
+            break;
+        }
+        if (!strcmp(p->token_str, id)) {
+            return i;
+        }
+        i += 1;
+    }
+    return -1;
+}
+
+/**
+ * Swap the registers the parameters passed in registers are read from with
+ * `regs`: those they were passed in for the early exits, and back again.
+ */
+static void swap_param_regs(Node* func, Scope* s, char** regs)
+{
+    int i = 0;
+    for (Node* p = func->child[0]; (p != NULL) && (i < NUM_ARG_REGS);
+            p = p->sibling) {
+        if (p->element.params->parameter_kind == PARAM_VOID) {
+            break;
+        }
+        Symbol* param = get_sym(&s, p->token_str);
+        char* reg = param->reg;
+        param->reg = regs[i];
+        regs[i] = reg;
+        i += 1;
+    }
+}
+
+/**
+ * Results are returned in $v0, as in the o32 convention, so that code not
+ * compiled by us can call ours. With -fwhole-program nothing else can, so
+ * they stay in $a0, where they were computed and where the caller wants
+ * them.
+ */
+static void gen_return_value(Symbol* sym, Target* target)
+{
+    if ((sym->type != TYPE_VOID) && !options.whole_program) {
+        fprintf(target->out, "move   $v0, $a0\n");
+    }
+}
+
+/**
+ * Keep the scalars of a function with a frame in the leaf registers that
+ * nothing it calls writes. Functions are compiled in order, and each is
+ * defined before it is called, so this is bottom-up over the call graph:
+ * what each callee, and in turn its callees, may write is already known
+ * (Symbol.clobbers). The most used variables get registers first, a use in
+ * a loop counting for more, or by how often it ran with --profile-use. A
+ * function that calls itself keeps nothing in registers, as the call would
+ * write them. $fp is left to leaves, as uses of it in a frame addressed
+ * from $sp are rebased (copy_stream).
+ */
+void allocate_registers(Node* n, Scope* s, Target* target)
+{
+    Symbol* func = get_func(&s);
+    if (func->frameless) {
+        func->clobbers = (1u << target->regs_used) - 1;
+        return;
+    }
+
+    bool recursive = false;
+    unsigned taken = callee_clobbers(n->child[1], s, func, &recursive);
+    if ((func->early_exits > 0) && (num_reg_params(func) > 0)) {
+        // Where the early exits keep the first parameter
+        taken |= 1;
+    }
+    func->clobbers = taken;
+    if (recursive) {
+        return;
+    }
+
+    int num = 0;
+    int cap = func->len;
+    for (Node* dec = n->child[1]->child[0]; dec != NULL; dec = dec->sibling) {
+        cap += 1;
+    }
+    Symbol** vars = calloc(cap + 1, sizeof(Symbol*));
+    long* uses = calloc(cap + 1, sizeof(long));
+
+    for (Node* p = n->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind == PARAM_VOID) {
+            break;
+        }
+        if (p->element.params->variable_kind == VAR_SINGLE) {
+            vars[num++] = get_sym(&s, p->token_str);
+        }
+    }
+    for (Node* dec = n->child[1]->child[0]; dec != NULL; dec = dec->sibling) {
+        if (dec->element.decl->var->variable_kind == VAR_SINGLE) {
+            vars[num++] = get_sym(&s, dec->token_str);
+        }
+    }
+
+    // Most used first, in order of declaration otherwise. A parameter
+    // passed on the stack has to be loaded on each entry, so a use per
+    // entry is no gain.
+    long entries = site_count(n->child[1]);
+    entries = (entries > 1) ? entries : 1;
+    for (int i = 0; i < num; ++i) {
+        uses[i] = count_uses(n->child[1], vars[i]->id, 0, -1);
+        if ((vars[i]->offset > 0) && (uses[i] <= entries)) {
+            uses[i] = 0;
+        }
+        for (int j = i; (j > 0) && (uses[j] > uses[j - 1]); --j) {
+            Symbol* var = vars[j];
+            long count = uses[j];
+            vars[j] = vars[j - 1];
+            uses[j] = uses[j - 1];
+            vars[j - 1] = var;
+            uses[j - 1] = count;
+        }
+    }
+
+    int kept = 0;
+    int r = 0;
+    for (int i = 0; (i < num) && (uses[i] > 0); ++i) {
+        while ((r < NUM_LEAF_REGS) && (taken & (1u << r))) {
+            r += 1;
+        }
+        if (r == NUM_LEAF_REGS) {
+            break;
+        }
+        vars[i]->reg = leaf_regs[r];
+        func->clobbers |= 1u << r;
+        kept += 1;
+        r += 1;
+    }
+
+    if (kept > 0) {
+        remark("kept %d variable(s) of '%s' in registers its callees leave "
+                "alone", kept, func->id);
+        count_stat("registers: variables kept across calls", kept);
+    }
+    free(vars);
+    free(uses);
+}
+
+/**
+ * The leaf registers that the functions called may write. Inlined bodies
+ * are searched too, and a call to ourselves that is a jump back to the
+ * start isn't a call.
+ */
+static unsigned callee_clobbers(Node* n, Scope* s, Symbol* func,
+        bool* recursive)
+{
+    unsigned clobbers = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE) &&
+                strcmp(n->token_str, "input") &&
+                strcmp(n->token_str, "output")) {
+            Symbol* callee = get_sym(&s, n->token_str);
+            if (callee != func) {
+                clobbers |= callee->clobbers;
+            } else if (n->element.call->call_kind != CALL_TAIL) {
+                *recursive = true;
+            }
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            clobbers |= callee_clobbers(n->child[i], s, func, recursive);
+        }
+    }
+    return clobbers;
+}
+
+/**
+ * References to a variable, each weighted by how many times the innermost
+ * profiled block around it ran, or without a profile by eight for every
+ * loop it is in.
+ */
+static long count_uses(Node* n, char* id, int depth, long count)
+{
+    long uses = 0;
+    for (; n != NULL; n = n->sibling) {
+        long block = (n->site != 0) ? site_count(n) : count;
+        if ((n->kind == NODE_VAR) && !strcmp(n->token_str, id)) {
+            uses += (block >= 0) ? block :
+                    1L << (3 * (depth < 8 ? depth : 8));
+        }
+        bool loop = (n->kind == NODE_STMT) &&
+                    (n->element.stmt->statement_kind == STMT_WHILE);
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            uses += count_uses(n->child[i], id, loop ? depth + 1 : depth,
+                    block);
+        }
+    }
+    return uses;
+}
@@ -0,0 +1,385 @@
+/**
+ * Function inlining.
+ *
+ * A call is replaced by a copy of the callee's body when the callee is a
+ * small leaf function, or when the call is the callee's only call site. The
+ * callee's parameters and locals are renamed into the caller's frame, and
+ * its returns become jumps to the end of the copied body (gen_inline_call).
+ *
+ * Functions are visited in program order. A function must be declared
+ * before it is called, so every callee has already had its own calls
+ * inlined by the time it is copied into a caller.
+ *
+ * With a profile, a call in a block that never ran is left alone, and one in
+ * a hot block may inline a callee several times larger than the threshold.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "optimise.h"
+#include "profile.h"
+#include "shared.h"
+
+// Instructions saved per call besides the arguments: saving $fp, the jal,
+// and the callee's prologue and epilogue
+#define CALL_OVERHEAD 12
+
+// Multiplies the threshold for calls in hot blocks
+#define HOT_THRESHOLD_FACTOR 4
+
+typedef struct Renames {
+    char** from;
+    char** to;
+    int num;
+    int cap;
+} Renames;
+
+typedef struct Inliner {
+    Node* program;
+    Node* caller;
+    long count;         // Runs of the block being visited, or -1
+
+    char** inlined;     // Callees that had at least one call inlined
+    int num_inlined;
+    int cap_inlined;
+} Inliner;
+
+static void inline_calls(Inliner* in, Node* n);
+static void inline_call(Inliner* in, Node* call, Node* callee);
+static char* reject_reason(Inliner* in, Node* callee, int* cost);
+static int threshold(Inliner* in);
+static int count_calls(Node* n, char* id);
+static char* find_capture(Node* callee, Node* n, Node* caller);
+static void hoist_locals(Node* caller, Node* n, Renames* r);
+static void rename_vars(Node* n, Renames* r);
+static void add_rename(Renames* r, char* from, char* to);
+static void remove_inlined(Inliner* in);
+
+/**
+ * Inline calls throughout the program, then remove any function whose every
+ * call was inlined.
+ */
+void inline_functions(Node* program)
+{
+    if (options.inline_threshold == 0) {
+        return;
+    }
+
+    Inliner in = { .program = program };
+
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        if (f->element.decl->declaration_kind == DEC_FUNC) {
+            in.caller = f;
+            in.count = site_count(f->child[1]);
+            inline_calls(&in, f->child[1]->child[1]);
+        }
+    }
+
+    remove_inlined(&in);
+    free(in.inlined);
+}
+
+/* Private */
+
+/**
+ * Visit every call in a list of statements, innermost first, so that the
+ * arguments of a call are dealt with before the call itself.
+ */
+static void inline_calls(Inliner* in, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        long outer = in->count;
+        if (n->site != 0) {
+            in->count = site_count(n);
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            inline_calls(in, n->child[i]);
+        }
+        in->count = outer;
+
+        if ((n->kind != NODE_CALL) ||
+                (n->element.call->call_kind == CALL_INLINE)) {
+            continue;
+        }
+
+        Node* callee = find_function(in->program, n->token_str);
+        if (callee == NULL) {
+            // input and output
+            continue;
+        }
+
+        int cost = 0;
+        char* reason = reject_reason(in, callee, &cost);
+        if (reason != NULL) {
+            remark("not inlining '%s' into '%s': %s", callee->token_str,
+                    in->caller->token_str, reason);
+            continue;
+        }
+
+        remark("inlined '%s' into '%s' (cost %d, threshold %d)",
+                callee->token_str, in->caller->token_str, cost,
+                threshold(in));
+        inline_call(in, n, callee);
+
+        // Calls left in the copy may be inlinable here even if they were not
+        // in the callee, e.g. once a shadowing parameter has been renamed
+        inline_calls(in, n->child[1]);
+    }
+}
+
+/**
+ * Why a call to `callee` from the current caller should not be inlined, or
+ * NULL if it should be. `cost` is the callee's size less the call overhead.
+ */
+static char* reject_reason(Inliner* in, Node* callee, int* cost)
+{
+    static char reason[128];
+
+    if (callee == in->caller) {
+        return "recursive";
+    }
+    if (!strcmp(callee->token_str, "main")) {
+        return "main";
+    }
+
+    if (has_array_param(callee)) {
+        return "array parameter";
+    }
+
+    char* capture = find_capture(callee, callee->child[1]->child[1],
+            in->caller);
+    if (capture != NULL) {
+        snprintf(reason, sizeof(reason), "global '%s' is shadowed in '%s'",
+                capture, in->caller->token_str);
+        return reason;
+    }
+
+    *cost = count_nodes(callee->child[1]->child[1]) -
+            (CALL_OVERHEAD + 2 * num_params(callee));
+
+    if (count_calls(in->program, callee->token_str) == 1) {
+        return NULL;
+    }
+    if (has_calls(callee->child[1]->child[1])) {
+        return "not a leaf and called more than once";
+    }
+    if (is_cold(in->count)) {
+        return "never called in the profile";
+    }
+    if (*cost > threshold(in)) {
+        snprintf(reason, sizeof(reason), "cost %d exceeds threshold %d",
+                *cost, threshold(in));
+        return reason;
+    }
+    return NULL;
+}
+
+/**
+ * The largest callee cost to inline at the current call.
+ */
+static int threshold(Inliner* in)
+{
+    if (is_hot(in->count)) {
+        return options.inline_threshold * HOT_THRESHOLD_FACTOR;
+    }
+    return options.inline_threshold;
+}
+
+/**
+ * Turn `call` into a CALL_INLINE whose body is a renamed copy of the
+ * callee's, preceded by an assignment of each argument to its parameter.
+ */
+static void inline_call(Inliner* in, Node* call, Node* callee)
+{
+    Renames r = { 0 };
+
+    Node* body = copy_tree(callee->child[1]);
+    hoist_locals(in->caller, body, &r);
+
+    // Arguments are assigned last to first, the order a call pushes them
+    Node* assigns = NULL;
+    Node* arg = call->child[0];
+    for (Node* p = callee->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind == PARAM_VOID) {
+            break;
+        }
+        assert(arg != NULL);
+
+        char* id = fresh_local(in->caller, p->token_str, "");
+        add_local(in->caller, id);
+        add_rename(&r, p->token_str, id);
+
+        Node* next = arg->sibling;
+        arg->sibling = NULL;
+        Node* assign = new_assign_stmt(id, arg);
+        assign->sibling = assigns;
+        assigns = assign;
+        arg = next;
+    }
+
+    rename_vars(body->child[1], &r);
+
+    if (assigns != NULL) {
+        Node* tail = assigns;
+        while (tail->sibling != NULL) {
+            tail = tail->sibling;
+        }
+        tail->sibling = body->child[1];
+        body->child[1] = assigns;
+    }
+
+    call->element.call->call_kind = CALL_INLINE;
+    call->child[0] = NULL;
+    call->child[1] = body;
+
+    for (int i = 0; i < in->num_inlined; ++i) {
+        if (!strcmp(in->inlined[i], callee->token_str)) {
+            free(r.from);
+            free(r.to);
+            return;
+        }
+    }
+    if (in->num_inlined == in->cap_inlined) {
+        in->cap_inlined = in->cap_inlined ? in->cap_inlined * 2 : 8;
+        in->inlined = realloc(in->inlined, sizeof(char*) * in->cap_inlined);
+    }
+    in->inlined[in->num_inlined++] = callee->token_str;
+
+    free(r.from);
+    free(r.to);
+}
+
+/**
+ * Calls to the function anywhere beneath `n`, including in inlined bodies.
+ */
+static int count_calls(Node* n, char* id)
+{
+    int calls = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE) &&
+                !strcmp(n->token_str, id)) {
+            calls += 1;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            calls += count_calls(n->child[i], id);
+        }
+    }
+    return calls;
+}
+
+/**
+ * A global used by the callee that the caller hides behind a local of the
+ * same name, which the inlined body would otherwise bind to instead.
+ */
+static char* find_capture(Node* callee, Node* n, Node* caller)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && !declares(callee, n->token_str) &&
+                declares(caller, n->token_str)) {
+            return n->token_str;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            char* capture = find_capture(callee, n->child[i], caller);
+            if (capture != NULL) {
+                return capture;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Move every declaration in the copied body, at any depth, to the caller's
+ * top-level declarations under a new name, so that it is given its own slot
+ * in the caller's frame.
+ */
+static void hoist_locals(Node* caller, Node* n, Renames* r)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            Node* dec = n->child[0];
+            while (dec != NULL) {
+                Node* next = dec->sibling;
+                dec->sibling = NULL;
+
+                char* id = fresh_local(caller, dec->token_str, "");
+                add_rename(r, dec->token_str, id);
+                dec->token_str = id;
+                append_decl(caller, dec);
+
+                dec = next;
+            }
+            n->child[0] = NULL;
+        }
+        if (n->kind != NODE_DEC) {
+            for (int i = 0; i < MAX_CHILDREN; ++i) {
+                hoist_locals(caller, n->child[i], r);
+            }
+        }
+    }
+}
+
+static void rename_vars(Node* n, Renames* r)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_VAR) {
+            for (int i = 0; i < r->num; ++i) {
+                if (!strcmp(n->token_str, r->from[i])) {
+                    n->token_str = r->to[i];
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            rename_vars(n->child[i], r);
+        }
+    }
+}
+
+static void add_rename(Renames* r, char* from, char* to)
+{
+    if (r->num == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 8;
+        r->from = realloc(r->from, sizeof(char*) * r->cap);
+        r->to = realloc(r->to, sizeof(char*) * r->cap);
+    }
+    r->from[r->num] = from;
+    r->to[r->num] = to;
+    r->num += 1;
+}
+
+/**
+ * Drop functions that are no longer called now that their calls have been
+ * inlined. The head of the list is overwritten rather than unlinked, as the
+ * caller holds a pointer to it.
+ */
+static void remove_inlined(Inliner* in)
+{
+    for (int i = 0; i < in->num_inlined; ++i) {
+        char* id = in->inlined[i];
+        if (count_calls(in->program, id) != 0) {
+            continue;
+        }
+
+        Node** link = &in->program;
+        while (*link != NULL) {
+            Node* n = *link;
+            if ((n->element.decl->declaration_kind == DEC_FUNC) &&
+                    !strcmp(n->token_str, id)) {
+                remark("removed '%s': every call was inlined", id);
+                if (n == in->program) {
+                    *n = *n->sibling;
+                } else {
+                    *link = n->sibling;
+                }
+                break;
+            }
+            link = &n->sibling;
+        }
+    }
+}
@@ -0,0 +1,421 @@
+/**
+ * Compile-time evaluation of calls.
+ *
+ * A call whose arguments are all literals, to a function without side
+ * effects, always returns the same value, so it can be run once here and
+ * replaced by its result. A function qualifies if it returns int, takes no
+ * arrays, reads and writes only its own variables, and calls nothing but
+ * functions that qualify too. That includes itself, so a recursive function
+ * such as a factorial can be evaluated.
+ *
+ * Functions are interpreted straight from the AST. Anything that would
+ * behave differently at run time stops evaluation and the call is left as
+ * it is: a trapping overflow or division, an index out of bounds, reading
+ * a variable before it is assigned, or running off the end of the
+ * function.
+ * Evaluation also stops after a number of steps, or calls deep, to bound
+ * the time spent compiling.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "optimise.h"
+#include "shared.h"
+
+// Expressions evaluated per call folded, and frames deep
+#define MAX_STEPS 100000
+#define MAX_DEPTH 256
+
+typedef struct Slot {
+    char* id;
+    int* values;
+    bool* assigned;
+    int len;        // Elements, or 0 for a scalar
+} Slot;
+
+typedef struct Frame {
+    Slot* slots;
+    int num_slots;
+    int cap_slots;
+} Frame;
+
+typedef struct Interpreter {
+    Node* program;
+    bool* pure;     // By function, in program order
+    int steps;
+    int depth;
+} Interpreter;
+
+typedef enum Outcome {
+    RUN_NORMAL,
+    RUN_RETURNED,
+    RUN_FAILED,
+} Outcome;
+
+static void find_pure(Interpreter* in);
+static bool is_pure_body(Interpreter* in, Node* func, Node* n);
+static bool is_pure(Interpreter* in, Node* func);
+static void fold_calls(Interpreter* in, Node* func, Node* n);
+static bool can_evaluate(Interpreter* in, Node* call);
+static bool call(Interpreter* in, Node* func, int* args, int* result);
+static void add_slots(Frame* f, Node* n);
+static Slot* add_slot(Frame* f, char* id, int len);
+static Slot* find_slot(Frame* f, char* id);
+static Outcome run(Interpreter* in, Frame* f, Node* n, int* result);
+static bool eval(Interpreter* in, Frame* f, Node* n, int* value);
+static bool eval_call(Interpreter* in, Frame* f, Node* n, int* value);
+static bool element(Interpreter* in, Frame* f, Node* var, Slot** slot,
+        int* index);
+
+void evaluate_calls(Node* program)
+{
+    int num_funcs = 0;
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        num_funcs += 1;
+    }
+
+    Interpreter in = {
+        .program = program,
+        .pure = calloc(sizeof(bool), num_funcs)
+    };
+    find_pure(&in);
+
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        if (f->element.decl->declaration_kind == DEC_FUNC) {
+            fold_calls(&in, f, f->child[1]);
+        }
+    }
+    free(in.pure);
+}
+
+/* Private */
+
+/**
+ * Start by assuming every function that returns int is pure, then strike
+ * off those that do anything else, or call one that has been struck off,
+ * until nothing changes.
+ */
+static void find_pure(Interpreter* in)
+{
+    int i = 0;
+    for (Node* f = in->program; f != NULL; f = f->sibling, ++i) {
+        in->pure[i] = (f->element.decl->declaration_kind == DEC_FUNC) &&
+                (f->element.decl->type == TYPE_INT) &&
+                !has_array_param(f);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        i = 0;
+        for (Node* f = in->program; f != NULL; f = f->sibling, ++i) {
+            if (in->pure[i] && !is_pure_body(in, f, f->child[1])) {
+                in->pure[i] = false;
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool is_pure_body(Interpreter* in, Node* func, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && !declares(func, n->token_str)) {
+            return false;
+        }
+        if ((n->kind == NODE_CALL) && !is_pure(in, find_function(
+                        in->program, n->token_str))) {
+            return false;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (!is_pure_body(in, func, n->child[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * True if the function is still thought to be pure. `input` and `output`
+ * aren't declared in the program, so are never found.
+ */
+static bool is_pure(Interpreter* in, Node* func)
+{
+    int i = 0;
+    for (Node* f = in->program; f != NULL; f = f->sibling, ++i) {
+        if (f == func) {
+            return in->pure[i];
+        }
+    }
+    return false;
+}
+
+/**
+ * Replace each call that can be evaluated with its result. Arguments are
+ * folded first, so that a call nested in another's arguments may make the
+ * outer call's arguments constant too.
+ */
+static void fold_calls(Interpreter* in, Node* func, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            fold_calls(in, func, n->child[i]);
+        }
+        if ((n->kind != NODE_CALL) || !can_evaluate(in, n)) {
+            continue;
+        }
+
+        // The arguments are literals, so evaluate in no frame at all
+        int result = 0;
+        in->steps = 0;
+        in->depth = 0;
+        if (!eval_call(in, NULL, n, &result)) {
+            continue;
+        }
+
+        remark("evaluated call to '%s' at compile time in '%s'",
+                n->token_str, func->token_str);
+        count_stat("interpret: calls evaluated", 1);
+        Node* sibling = n->sibling;
+        *n = *new_num(result);
+        n->sibling = sibling;
+    }
+}
+
+static bool can_evaluate(Interpreter* in, Node* call)
+{
+    if (call->element.call->call_kind == CALL_INLINE) {
+        return false;
+    }
+    for (Node* arg = call->child[0]; arg != NULL; arg = arg->sibling) {
+        if (arg->kind != NODE_FACTOR) {
+            return false;
+        }
+    }
+    return is_pure(in, find_function(in->program, call->token_str));
+}
+
+/**
+ * Run a function on the given arguments. Returns false if it could not be
+ * evaluated, and otherwise stores what it returns in `result`.
+ */
+static bool call(Interpreter* in, Node* func, int* args, int* result)
+{
+    if (in->depth == MAX_DEPTH) {
+        return false;
+    }
+
+    Frame f = { 0 };
+    int i = 0;
+    for (Node* p = func->child[0]; p != NULL; p = p->sibling) {
+        if (p->element.params->parameter_kind != PARAM_VOID) {
+            Slot* slot = add_slot(&f, p->token_str, 0);
+            slot->values[0] = args[i++];
+            slot->assigned[0] = true;
+        }
+    }
+    add_slots(&f, func->child[1]);
+
+    in->depth += 1;
+    Outcome outcome = run(in, &f, func->child[1], result);
+    in->depth -= 1;
+
+    for (int s = 0; s < f.num_slots; ++s) {
+        free(f.slots[s].values);
+        free(f.slots[s].assigned);
+    }
+    free(f.slots);
+    return outcome == RUN_RETURNED;
+}
+
+/**
+ * A slot for every local declared in the body, nested blocks included.
+ */
+static void add_slots(Frame* f, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_DEC) {
+            Variable* var = n->element.decl->var;
+            add_slot(f, n->token_str,
+                    (var->variable_kind == VAR_ARRAY) ? var->arr_len : 0);
+            continue;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            add_slots(f, n->child[i]);
+        }
+    }
+}
+
+static Slot* add_slot(Frame* f, char* id, int len)
+{
+    if (f->num_slots == f->cap_slots) {
+        f->cap_slots = f->cap_slots ? f->cap_slots * 2 : 8;
+        f->slots = realloc(f->slots, sizeof(Slot) * f->cap_slots);
+    }
+
+    int size = len ? len : 1;
+    Slot* slot = &f->slots[f->num_slots++];
+    *slot = (Slot) {
+        .id = id,
+        .values = calloc(sizeof(int), size),
+        .assigned = calloc(sizeof(bool), size),
+        .len = len
+    };
+    return slot;
+}
+
+static Slot* find_slot(Frame* f, char* id)
+{
+    for (int i = 0; i < f->num_slots; ++i) {
+        if (!strcmp(f->slots[i].id, id)) {
+            return &f->slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run a statement list, storing the value of any return in `result`.
+ */
+static Outcome run(Interpreter* in, Frame* f, Node* n, int* result)
+{
+    int value = 0;
+    Outcome outcome = RUN_NORMAL;
+
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            outcome = run(in, f, n->child[1], result);
+        } else if (n->kind == NODE_STMT) {
+            switch (n->element.stmt->statement_kind) {
+                case STMT_EXPR:
+                    if ((n->child[0] != NULL) &&
+                            !eval(in, f, n->child[0], &value)) {
+                        return RUN_FAILED;
+                    }
+                    break;
+                case STMT_IF:
+                    if (!eval(in, f, n->child[0], &value)) {
+                        return RUN_FAILED;
+                    }
+                    outcome = run(in, f, value ? n->child[1] : n->child[2],
+                            result);
+                    break;
+                case STMT_WHILE:
+                    while (outcome == RUN_NORMAL) {
+                        if (!eval(in, f, n->child[0], &value)) {
+                            return RUN_FAILED;
+                        }
+                        if (value == 0) {
+                            break;
+                        }
+                        outcome = run(in, f, n->child[1], result);
+                    }
+                    break;
+                case STMT_RETURN:
+                    if ((n->child[0] == NULL) ||
+                            !eval(in, f, n->child[0], result)) {
+                        return RUN_FAILED;
+                    }
+                    return RUN_RETURNED;
+                default:
+                    return RUN_FAILED;
+            }
+        }
+
+        if (outcome != RUN_NORMAL) {
+            return outcome;
+        }
+    }
+    return RUN_NORMAL;
+}
+
+/**
+ * Evaluate an expression in the frame. Returns false if it can't be, or if
+ * the step limit has been reached.
+ */
+static bool eval(Interpreter* in, Frame* f, Node* n, int* value)
+{
+    int lhs = 0;
+    int rhs = 0;
+    int index = 0;
+    Slot* slot = NULL;
+
+    if (++in->steps > MAX_STEPS) {
+        return false;
+    }
+
+    switch (n->kind) {
+        case NODE_FACTOR:
+            *value = atoi(n->token_str);
+            return true;
+        case NODE_VAR:
+            if (!element(in, f, n, &slot, &index) ||
+                    !slot->assigned[index]) {
+                return false;
+            }
+            *value = slot->values[index];
+            return true;
+        case NODE_EXPR:
+            // The target's index is evaluated after the value, as by cgen
+            if (!eval(in, f, n->child[1], value) ||
+                    !element(in, f, n->child[0], &slot, &index)) {
+                return false;
+            }
+            slot->values[index] = *value;
+            slot->assigned[index] = true;
+            return true;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return eval(in, f, n->child[0], &lhs) &&
+                    eval(in, f, n->child[1], &rhs) &&
+                    evaluate_op(n->token_str, lhs, rhs, value);
+        case NODE_CALL:
+            return eval_call(in, f, n, value);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Evaluate the arguments of a call, left to right, then the call itself.
+ */
+static bool eval_call(Interpreter* in, Frame* f, Node* n, int* value)
+{
+    Node* callee = find_function(in->program, n->token_str);
+    int* args = malloc(sizeof(int) * (num_params(callee) + 1));
+    bool ok = true;
+
+    int i = 0;
+    for (Node* arg = n->child[0]; ok && (arg != NULL); arg = arg->sibling) {
+        ok = eval(in, f, arg, &args[i++]);
+    }
+    ok = ok && call(in, callee, args, value);
+
+    free(args);
+    return ok;
+}
+
+/**
+ * Find the slot and index that a variable reference refers to, evaluating
+ * the index of an array element and checking its bounds.
+ */
+static bool element(Interpreter* in, Frame* f, Node* var, Slot** slot,
+        int* index)
+{
+    *slot = find_slot(f, var->token_str);
+    *index = 0;
+    if ((*slot == NULL) || is_deref(var) ||
+            (var->element.var->variable_kind == VAR_ADDRESS)) {
+        return false;
+    }
+    if (var->child[0] == NULL) {
+        return (*slot)->len == 0;
+    }
+    return eval(in, f, var->child[0], index) && (*index >= 0) &&
+            (*index < (*slot)->len);
+}
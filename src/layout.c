@@ -0,0 +1,108 @@
+/**
+ * Block layout for if statements.
+ *
+ * An if is generated as a branch to one arm with the other falling through
+ * after it (gen_if), so the arm that is more likely to run should be the
+ * one that falls through. With a profile the likelier arm is the one whose
+ * block ran more often, the count of an if with no else arm being what is
+ * left of its enclosing block's. Without one, an arm that returns is taken
+ * to be an early exit or error path and so unlikely.
+ *
+ * The arm that is branched to is moved out of line, after the function's
+ * exit, when it never ran in the profile or returns while the other arm
+ * doesn't. Straight-line code through the function then takes no branches
+ * around it, and a returning arm needs no branch back either.
+ *
+ * Loops need no layout: they are rotated so that the back-edge is the
+ * branch taken (gen_while).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "optimise.h"
+#include "profile.h"
+#include "shared.h"
+
+static void lay_out_stmts(Node* func, Node* n, long count);
+static void lay_out_if(Node* func, Node* n, long count);
+static bool is_unlikely(Node* arm, Node* other);
+
+void lay_out_blocks(Node* program)
+{
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        if (f->element.decl->declaration_kind == DEC_FUNC) {
+            lay_out_stmts(f, f->child[1], site_count(f->child[1]));
+        }
+    }
+}
+
+/* Private */
+
+/**
+ * Every list beneath `n` is walked, keeping the count of the innermost
+ * block that was a site.
+ */
+static void lay_out_stmts(Node* func, Node* n, long count)
+{
+    for (; n != NULL; n = n->sibling) {
+        long block = (n->site != 0) ? site_count(n) : count;
+        if ((n->kind == NODE_STMT) &&
+                (n->element.stmt->statement_kind == STMT_IF)) {
+            lay_out_if(func, n, block);
+        }
+
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            lay_out_stmts(func, n->child[i], block);
+        }
+    }
+}
+
+static void lay_out_if(Node* func, Node* n, long count)
+{
+    Statement* stmt = n->element.stmt;
+    Node* then_arm = n->child[1];
+    Node* else_arm = n->child[2];
+
+    long then_count = site_count(then_arm);
+    long else_count = site_count(else_arm);
+    if ((else_arm == NULL) && (count >= 0) && (then_count >= 0)) {
+        else_count = (count > then_count) ? count - then_count : 0;
+    }
+    if ((then_count >= 0) && (else_count >= 0) &&
+            (then_count != else_count)) {
+        stmt->else_first = else_count > then_count;
+    } else {
+        stmt->else_first = is_unlikely(then_arm, else_arm) &&
+                           !is_unlikely(else_arm, then_arm);
+    }
+
+    Node* first = stmt->else_first ? else_arm : then_arm;
+    Node* second = stmt->else_first ? then_arm : else_arm;
+    long second_count = stmt->else_first ? then_count : else_count;
+    stmt->out_of_line = (second != NULL) &&
+                        (is_cold(second_count) ||
+                         (!can_complete(second) && can_complete(first)));
+
+    if (stmt->else_first) {
+        remark("laid out an if in '%s' with its else arm falling through",
+                func->token_str);
+        count_stat("layout: arms swapped", 1);
+    }
+    if (stmt->out_of_line) {
+        remark("moved an arm of an if in '%s' after the function's exit",
+                func->token_str);
+        count_stat("layout: arms moved out of line", 1);
+    }
+}
+
+/**
+ * An arm that returns is unlikely, unless the other one does too.
+ */
+static bool is_unlikely(Node* arm, Node* other)
+{
+    return (arm != NULL) && !can_complete(arm) && can_complete(other);
+}
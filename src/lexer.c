@@ -56,6 +56,15 @@ static Token* iterate(Input* in)
                 else if (c == '=') {
                     state = IN_ASSIGN;
                 }
+                else if (c == '<') {
+                    state = IN_LESS;
+                }
+                else if (c == '>') {
+                    state = IN_GREAT;
+                }
+                else if (c == '!') {
+                    state = IN_NOT;
+                }
                 else if (c == '\n') {
                     save = false;
                     in->line_num += 1;
@@ -78,8 +87,6 @@ static Token* iterate(Input* in)
                         case '+': token = PLUS; break;
                         case '-': token = MINUS; break;
                         case '*': token = TIMES; break;
-                        case '<': token = LESS; break;
-                        case '>': token = GREAT; break;
                         case ',': token = COMMA; break;
                         case ';': token = SEMI_COL; break;
                         case '(': token = O_PAREN; break;
@@ -119,6 +126,39 @@ static Token* iterate(Input* in)
                     token = ASSIGN;
                 }
                 break;
+            case IN_LESS:
+                state = DONE;
+                if (c == '=') {
+                    token = LEQ;
+                }
+                else {
+                    unget_char(in);
+                    save = false;
+                    token = LESS;
+                }
+                break;
+            case IN_GREAT:
+                state = DONE;
+                if (c == '=') {
+                    token = GEQ;
+                }
+                else {
+                    unget_char(in);
+                    save = false;
+                    token = GREAT;
+                }
+                break;
+            case IN_NOT:
+                state = DONE;
+                if (c == '=') {
+                    token = N_EQUAL;
+                }
+                else {
+                    unget_char(in);
+                    save = false;
+                    token = ERROR;
+                }
+                break;
             case IN_DIV:
                 if (c == '/') {
                     save = false;
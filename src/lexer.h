@@ -14,6 +14,9 @@ enum State {
     IN_DIV, 
     IN_COMMENT, 
     IN_EQ, 
+    IN_LESS,
+    IN_GREAT,
+    IN_NOT,
     DONE 
 };
 
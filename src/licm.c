@@ -0,0 +1,337 @@
+/**
+ * Loop-invariant code motion.
+ *
+ * Loops are the natural loops of a function's control flow graph, found from
+ * its dominators; each is headed by the block that tests a while condition.
+ * An expression in a loop whose value cannot change while the loop runs is
+ * computed once into a new local, assigned just before the while statement,
+ * which serves as the loop's preheader.
+ *
+ * The condition is evaluated on entry to the loop whatever happens, so any
+ * invariant part of it may be hoisted. Elsewhere in the loop an expression
+ * might never have been evaluated, so only those that cannot fault are:
+ * not array reads, nor divisions other than by a non-zero constant.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "optimise.h"
+#include "shared.h"
+
+typedef struct Loop {
+    Node* func;
+    Cfg* cfg;
+    bool* blocks;       // Membership, by block id
+    Node* header;       // The while statement
+
+    char** written;     // Scalars and arrays assigned in the loop
+    int num_written;
+    int cap_written;
+    bool calls;         // Calls a function, which may write any global
+    bool array_stores;  // Stores to an array
+
+    Node** hoisted;     // Expressions moved to the preheader, by temporary
+    char** temps;
+    int num_hoisted;
+    int cap_hoisted;
+} Loop;
+
+static bool hoist_loop(Node* func, Cfg* cfg, Block* header);
+static void scan_writes(Loop* loop, Node* n);
+static void hoist_expr(Loop* loop, Node* n, bool in_cond);
+static bool is_invariant(Loop* loop, Node* n);
+static bool is_written(Loop* loop, char* id);
+static bool can_fault(Node* n);
+static bool is_worth_hoisting(Loop* loop, Node* n);
+
+/**
+ * Hoist invariant expressions out of every loop in the program. Loops are
+ * revisited until nothing moves, so that an expression hoisted out of an
+ * inner loop can then be hoisted out of the loop around it.
+ */
+void hoist_invariants(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->element.decl->declaration_kind != DEC_FUNC) {
+            continue;
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            Cfg* cfg = build_cfg(n);
+            compute_dominators(cfg);
+            for (int i = 0; (i < cfg->num_blocks) && !changed; ++i) {
+                Block* b = cfg->blocks[i];
+                if (b->reachable && (b->branch != NULL) &&
+                        (b->branch->element.stmt->statement_kind ==
+                         STMT_WHILE)) {
+                    changed = hoist_loop(n, cfg, b);
+                }
+            }
+            free_cfg(cfg);
+        }
+    }
+}
+
+/* Private */
+
+/**
+ * Hoist what can be hoisted out of the loop headed by `header`. Returns true
+ * if anything moved, after which the graph is out of date.
+ */
+static bool hoist_loop(Node* func, Cfg* cfg, Block* header)
+{
+    bool* blocks = natural_loop(cfg, header);
+    if (blocks == NULL) {
+        return false;
+    }
+
+    Loop loop = {
+        .func = func,
+        .cfg = cfg,
+        .blocks = blocks,
+        .header = header->branch
+    };
+
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        if (!blocks[i]) {
+            continue;
+        }
+        for (int s = 0; s < b->num_stmts; ++s) {
+            scan_writes(&loop, b->stmts[s]->child[0]);
+        }
+        if (b->branch != NULL) {
+            scan_writes(&loop, b->branch->child[0]);
+        }
+    }
+
+    hoist_expr(&loop, header->branch->child[0], true);
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        if (!blocks[i] || (b == header)) {
+            continue;
+        }
+        for (int s = 0; s < b->num_stmts; ++s) {
+            hoist_expr(&loop, b->stmts[s]->child[0], false);
+        }
+        if (b->branch != NULL) {
+            hoist_expr(&loop, b->branch->child[0], false);
+        }
+    }
+
+    // Temporaries are assigned in the order they were made, so that one
+    // hoisted expression may use another
+    for (int i = 0; i < loop.num_hoisted; ++i) {
+        insert_before(loop.header,
+                new_assign_stmt(loop.temps[i], loop.hoisted[i]));
+        // The while statement has moved on to a new node
+        loop.header = loop.header->sibling;
+    }
+
+    bool changed = loop.num_hoisted > 0;
+    free(loop.written);
+    free(loop.hoisted);
+    free(loop.temps);
+    free(blocks);
+    return changed;
+}
+
+/**
+ * Record everything the expression assigns and whether it calls anything
+ * that could assign a global. Inlined bodies are searched too.
+ */
+static void scan_writes(Loop* loop, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_EXPR) {
+            Node* target = n->child[0];
+            if ((target->child[0] != NULL) || is_deref(target)) {
+                loop->array_stores = true;
+            }
+            if (loop->num_written == loop->cap_written) {
+                loop->cap_written = loop->cap_written ?
+                        loop->cap_written * 2 : 8;
+                loop->written = realloc(loop->written,
+                        sizeof(char*) * loop->cap_written);
+            }
+            loop->written[loop->num_written++] = target->token_str;
+        } else if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind != CALL_INLINE) &&
+                strcmp(n->token_str, "input") &&
+                strcmp(n->token_str, "output")) {
+            loop->calls = true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            scan_writes(loop, n->child[i]);
+        }
+    }
+}
+
+/**
+ * Replace the largest invariant parts of the expression with temporaries.
+ * Inlined bodies have their own control flow, so are left alone.
+ */
+static void hoist_expr(Loop* loop, Node* n, bool in_cond)
+{
+    if (n == NULL) {
+        return;
+    }
+
+    if (is_worth_hoisting(loop, n) && is_invariant(loop, n) &&
+            (in_cond || !can_fault(n))) {
+        char* temp = NULL;
+        for (int i = 0; i < loop->num_hoisted; ++i) {
+            if (same_tree(loop->hoisted[i], n)) {
+                temp = loop->temps[i];
+                break;
+            }
+        }
+
+        if (temp == NULL) {
+            temp = fresh_local(loop->func, loop->func->token_str, "inv");
+            add_local(loop->func, temp);
+
+            if (loop->num_hoisted == loop->cap_hoisted) {
+                loop->cap_hoisted = loop->cap_hoisted ?
+                        loop->cap_hoisted * 2 : 8;
+                loop->hoisted = realloc(loop->hoisted,
+                        sizeof(Node*) * loop->cap_hoisted);
+                loop->temps = realloc(loop->temps,
+                        sizeof(char*) * loop->cap_hoisted);
+            }
+            Node* sibling = n->sibling;
+            n->sibling = NULL;
+            loop->hoisted[loop->num_hoisted] = copy_tree(n);
+            n->sibling = sibling;
+            loop->temps[loop->num_hoisted] = temp;
+            loop->num_hoisted += 1;
+
+            remark("hoisted invariant expression out of loop in '%s'",
+                    loop->func->token_str);
+        }
+
+        Node* sibling = n->sibling;
+        *n = *new_var(temp);
+        n->sibling = sibling;
+        return;
+    }
+
+    switch (n->kind) {
+        case NODE_EXPR:
+            // The target itself stays, but its index may be hoisted
+            hoist_expr(loop, n->child[0]->child[0], in_cond);
+            hoist_expr(loop, n->child[1], in_cond);
+            break;
+        case NODE_VAR:
+            hoist_expr(loop, n->child[0], in_cond);
+            break;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            hoist_expr(loop, n->child[0], in_cond);
+            hoist_expr(loop, n->child[1], in_cond);
+            break;
+        case NODE_CALL:
+            if (n->element.call->call_kind != CALL_INLINE) {
+                for (Node* arg = n->child[0]; arg != NULL;
+                        arg = arg->sibling) {
+                    hoist_expr(loop, arg, in_cond);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * True if the expression has the same value on every iteration.
+ */
+static bool is_invariant(Loop* loop, Node* n)
+{
+    switch (n->kind) {
+        case NODE_FACTOR:
+            return true;
+        case NODE_VAR:
+            if (is_written(loop, n->token_str) || is_deref(n)) {
+                return false;
+            }
+            if (n->child[0] != NULL) {
+                // An array may be written through a call, or through an
+                // array parameter under another name
+                return !loop->calls && !(loop->array_stores &&
+                        has_array_param(loop->func)) &&
+                        is_invariant(loop, n->child[0]);
+            }
+            return !loop->calls || declares(loop->func, n->token_str);
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return (n->child[1]->kind != NODE_SEXPR) &&
+                    is_invariant(loop, n->child[0]) &&
+                    is_invariant(loop, n->child[1]);
+        default:
+            return false;
+    }
+}
+
+static bool is_written(Loop* loop, char* id)
+{
+    for (int i = 0; i < loop->num_written; ++i) {
+        if (!strcmp(loop->written[i], id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * True if evaluating the expression could stop the program: an array read
+ * out of bounds, or a division by zero.
+ */
+static bool can_fault(Node* n)
+{
+    if (n == NULL) {
+        return false;
+    }
+
+    switch (n->kind) {
+        case NODE_VAR:
+            return n->child[0] != NULL;
+        case NODE_TERM:
+            if (!strcmp(n->token_str, "/") &&
+                    ((n->child[1]->kind != NODE_FACTOR) ||
+                     (atoi(n->child[1]->token_str) == 0))) {
+                return true;
+            }
+            return can_fault(n->child[0]) || can_fault(n->child[1]);
+        case NODE_ADDIT:
+            return can_fault(n->child[0]) || can_fault(n->child[1]);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Arithmetic, and reads of globals and arrays, which need their address
+ * computing. A local or a constant is as cheap to read as a temporary.
+ */
+static bool is_worth_hoisting(Loop* loop, Node* n)
+{
+    switch (n->kind) {
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return true;
+        case NODE_VAR:
+            return (n->child[0] != NULL) ||
+                    !declares(loop->func, n->token_str);
+        default:
+            return false;
+    }
+}
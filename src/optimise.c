@@ -0,0 +1,173 @@
+/**
+ * Run the optimisation passes over the analysed AST, ahead of cgen.
+ *
+ * Passes are named, and a pipeline is a comma-separated list of names run
+ * in order, the same pass perhaps more than once. Each -O level has a preset
+ * pipeline, and --passes gives one explicitly. Passes may be timed, and the
+ * tree dumped after each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "optimise.h"
+
+typedef struct Pass {
+    const char* name;
+    void (*run)(Node* n);
+} Pass;
+
+static const Pass PASSES[] = {
+    { "dce", eliminate_dead_code },
+    { "accumulate", introduce_accumulators },
+    { "sccp", propagate_constants },
+    { "interpret", evaluate_calls },
+    { "inline", inline_functions },
+    { "licm", hoist_invariants },
+    { "unroll", unroll_loops },
+    { "strength", reduce_induction_variables },
+    { "cse", eliminate_common_subexpressions },
+    { "tail", mark_tail_calls },
+    { "rotate", mark_loop_entries },
+    { "layout", lay_out_blocks }
+};
+
+#define NUM_PASSES (int) (sizeof(PASSES) / sizeof(PASSES[0]))
+
+static const char* PIPELINES[] = {
+    // -O0: none, for the quickest compile
+    "",
+    // -O1: cheap passes that don't grow the code
+    "dce,sccp,dce,tail,rotate,layout",
+    // -O2
+    "dce,accumulate,sccp,interpret,inline,sccp,dce,licm,unroll,strength,"
+    "cse,dce,tail,rotate,layout"
+};
+
+static const char* NODE_KINDS[] = {
+    "none", "dec", "cstmt", "var", "stmt", "params", "expr", "sexpr",
+    "addit", "term", "factor", "call", "args"
+};
+
+static const char* STATEMENT_KINDS[] = {
+    "none", "expr", "compound", "if", "while", "return"
+};
+
+static const Pass* find_pass(const char* name, size_t len);
+static void run_pass(const Pass* pass, Node* n);
+static void dump_tree(Node* n, int depth);
+
+void optimise(Node* n)
+{
+    const char* pipeline = (options.passes != NULL) ? options.passes :
+                                                      PIPELINES[options.level];
+
+    for (const char* name = pipeline; *name != '\0'; ) {
+        size_t len = strcspn(name, ",");
+        if (len > 0) {
+            run_pass(find_pass(name, len), n);
+        }
+        name += (name[len] == ',') ? len + 1 : len;
+    }
+}
+
+/**
+ * Check that each name in a pipeline is a pass, or exit.
+ */
+void check_pipeline(const char* pipeline)
+{
+    for (const char* name = pipeline; *name != '\0'; ) {
+        size_t len = strcspn(name, ",");
+        if (len > 0) {
+            find_pass(name, len);
+        }
+        name += (name[len] == ',') ? len + 1 : len;
+    }
+}
+
+/* Private */
+
+static const Pass* find_pass(const char* name, size_t len)
+{
+    for (int i = 0; i < NUM_PASSES; ++i) {
+        if ((strlen(PASSES[i].name) == len) &&
+                !strncmp(PASSES[i].name, name, len)) {
+            return &PASSES[i];
+        }
+    }
+
+    printf("Error: unknown pass '%.*s', expected one of:", (int) len, name);
+    for (int i = 0; i < NUM_PASSES; ++i) {
+        printf(" %s", PASSES[i].name);
+    }
+    printf("\n");
+    exit(ARGC_ERROR);
+}
+
+static void run_pass(const Pass* pass, Node* n)
+{
+    clock_t start = clock();
+    pass->run(n);
+    clock_t end = clock();
+
+    if (options.time_passes) {
+        fprintf(stderr, "%8.3f ms %s\n",
+                1000.0 * (end - start) / CLOCKS_PER_SEC, pass->name);
+    }
+    if (options.dump_passes) {
+        fprintf(stderr, "; after %s\n", pass->name);
+        dump_tree(n, 0);
+    }
+}
+
+/**
+ * Print each node on a line of its own, indented beneath its parent, with
+ * its token and anything the passes marked on it.
+ */
+static void dump_tree(Node* n, int depth)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_NONE) {
+            // A placeholder, as for a missing else arm
+            continue;
+        }
+
+        fprintf(stderr, "%*s%s", 2 * depth, "", NODE_KINDS[n->kind]);
+        if (n->kind == NODE_DEC) {
+            fprintf(stderr, " %s",
+                    (n->element.decl->declaration_kind == DEC_FUNC) ?
+                    "func" : "var");
+        } else if (n->kind == NODE_STMT) {
+            Statement* stmt = n->element.stmt;
+            fprintf(stderr, " %s%s%s%s",
+                    STATEMENT_KINDS[stmt->statement_kind],
+                    stmt->enters ? " enters" : "",
+                    stmt->else_first ? " else-first" : "",
+                    stmt->out_of_line ? " out-of-line" : "");
+        } else if (is_deref(n)) {
+            fprintf(stderr, " deref %d", n->element.var->offset);
+        } else if ((n->kind == NODE_VAR) &&
+                (n->element.var->variable_kind == VAR_ADDRESS)) {
+            fprintf(stderr, " address");
+        } else if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind == CALL_INLINE)) {
+            fprintf(stderr, " inline");
+        } else if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind == CALL_TAIL)) {
+            fprintf(stderr, " tail");
+        }
+        if (n->token_str != NULL) {
+            fprintf(stderr, " %s", n->token_str);
+        }
+        if (n->site != 0) {
+            fprintf(stderr, " (site %d)", n->site);
+        }
+        fprintf(stderr, "\n");
+
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            dump_tree(n->child[i], depth + 1);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+/**
+ * Optimisation passes over the analysed AST.
+ */
+
+#pragma once
+
+#include "ast.h"
+
+/* Function Prototypes */
+void optimise(Node* n);
+void check_pipeline(const char* pipeline);
+
+// Passes
+void eliminate_dead_code(Node* n);
+void introduce_accumulators(Node* n);
+void evaluate_calls(Node* n);
+void inline_functions(Node* n);
+void propagate_constants(Node* n);
+void hoist_invariants(Node* n);
+void unroll_loops(Node* n);
+void reduce_induction_variables(Node* n);
+void eliminate_common_subexpressions(Node* n);
+void mark_tail_calls(Node* n);
+void mark_loop_entries(Node* n);
+void lay_out_blocks(Node* n);
@@ -460,8 +460,9 @@ static Node* expression(Input* input, Token** tokens)
         match(input, tokens, ID);
 
         if ((*tokens)->token == O_PAREN) {
+            // A call may be the first operand of a larger expression
             unget_token(input, tokens);
-            node = call(input, tokens);
+            node = simple_expression(input, tokens);
         } else {
             unget_token(input, tokens);
             node->child[0] = var(input, tokens);
@@ -0,0 +1,152 @@
+/**
+ * Profiles of block execution counts.
+ *
+ * Each block that a branch can lead to, a function's body, either arm of an
+ * if and the body of a loop, is numbered as a site before any optimisation,
+ * so that the numbering depends only on the source. The number is kept on
+ * the block's node, and goes wherever the node is moved or copied, so an
+ * inlined body still counts towards its function. Unrolling copies a loop's
+ * statements rather than its body, so is left out while counting.
+ *
+ * With --profile-generate, cgen gives each site a counter that its block
+ * increments, and main prints them all on exit after a `#profile` line.
+ * Saving the program's output and passing it to --profile-use gives later
+ * optimisations the counts: a site is cold if its block never ran, and hot
+ * if it ran at least a tenth as often as the busiest block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "profile.h"
+#include "shared.h"
+
+// Divides the busiest block's count to give the least that is hot
+#define HOT_FRACTION 10
+
+#define PROFILE_MARKER "#profile\n"
+
+static int sites = 0;
+static long* counts = NULL; // By site less one, if a profile was read
+static long max_count = 0;
+
+static void number_block(Node* n);
+static void number_stmts(Node* n);
+static void number_stmt(Node* n);
+
+/**
+ * Number the sites of the program in source order.
+ */
+void number_sites(Node* program)
+{
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        if (f->element.decl->declaration_kind == DEC_FUNC) {
+            number_block(f->child[1]);
+        }
+    }
+}
+
+int num_sites(void)
+{
+    return sites;
+}
+
+/**
+ * Read the counts printed after the last `#profile` line of a program's
+ * output. There must be one for each site.
+ */
+void read_profile(const char* filename)
+{
+    struct String text = read_whole_file(filename);
+    if (text.buffer == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    char* start = NULL;
+    for (char* s = text.buffer; (s = strstr(s, PROFILE_MARKER)) != NULL;
+            s += strlen(PROFILE_MARKER)) {
+        start = s + strlen(PROFILE_MARKER);
+    }
+    if (start == NULL) {
+        printf("Error: no profile in '%s'\n", filename);
+        exit(ARGC_ERROR);
+    }
+
+    counts = calloc(sizeof(long), sites + 1);
+    int read = 0;
+    char* end = NULL;
+    for (long count = strtol(start, &end, 10); end != start;
+            count = strtol(start, &end, 10)) {
+        if (read < sites) {
+            counts[read] = count;
+            max_count = (count > max_count) ? count : max_count;
+        }
+        read += 1;
+        start = end;
+    }
+    if (read != sites) {
+        printf("Error: profile in '%s' has %d counts for %d blocks\n",
+                filename, read, sites);
+        exit(ARGC_ERROR);
+    }
+    free(text.buffer);
+}
+
+/**
+ * How many times the block at a node ran, or -1 if it isn't a site or
+ * there is no profile.
+ */
+long site_count(Node* n)
+{
+    if ((counts == NULL) || (n == NULL) || (n->site == 0)) {
+        return -1;
+    }
+    return counts[n->site - 1];
+}
+
+bool is_hot(long count)
+{
+    return (count > 0) && (count * HOT_FRACTION >= max_count);
+}
+
+bool is_cold(long count)
+{
+    return count == 0;
+}
+
+/* Private */
+
+static void number_block(Node* n)
+{
+    if (n == NULL) {
+        return;
+    }
+    n->site = ++sites;
+    number_stmt(n);
+}
+
+static void number_stmts(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        number_stmt(n);
+    }
+}
+
+/**
+ * Number the blocks nested in a statement.
+ */
+static void number_stmt(Node* n)
+{
+    if (n->kind == NODE_CSTMT) {
+        number_stmts(n->child[1]);
+    } else if ((n->kind == NODE_STMT) &&
+            (n->element.stmt->statement_kind == STMT_IF)) {
+        number_block(n->child[1]);
+        number_block(n->child[2]);
+    } else if ((n->kind == NODE_STMT) &&
+            (n->element.stmt->statement_kind == STMT_WHILE)) {
+        number_block(n->child[1]);
+    }
+}
@@ -0,0 +1,18 @@
+/**
+ * Block execution counts, gathered by --profile-generate and read back by
+ * --profile-use.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "ast.h"
+
+/* Function Prototypes */
+void number_sites(Node* program);
+int num_sites(void);
+void read_profile(const char* filename);
+long site_count(Node* n);
+bool is_hot(long count);
+bool is_cold(long count);
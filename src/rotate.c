@@ -0,0 +1,150 @@
+/**
+ * Loop entry analysis for rotated loops.
+ *
+ * The generator rotates every while loop into a guard followed by a body
+ * that tests the condition at its bottom (gen_while). The guard can be left
+ * out when the condition is known to hold on entry, as for a counter set to
+ * a constant just before the loop: `i = 0; while (i < 10) ...`.
+ *
+ * Each statement list is walked from its start, tracking scalars assigned
+ * a constant. Anything else, a call, a store to an array, or a statement
+ * with control flow, forgets what is known.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "optimise.h"
+#include "shared.h"
+
+typedef struct Known {
+    char** ids;
+    int* values;
+    int num;
+    int cap;
+} Known;
+
+static void mark_stmts(Node* func, Node* n);
+static void learn(Known* k, Node* stmt);
+static bool evaluate(Known* k, Node* n, int* value);
+
+void mark_loop_entries(Node* program)
+{
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        if (f->element.decl->declaration_kind == DEC_FUNC) {
+            mark_stmts(f, f->child[1]);
+        }
+    }
+}
+
+/* Private */
+
+/**
+ * Every list beneath `n` is walked, expressions included, so that loops in
+ * inlined bodies are found too.
+ */
+static void mark_stmts(Node* func, Node* n)
+{
+    Known k = { 0 };
+
+    for (; n != NULL; n = n->sibling) {
+        int value = 0;
+        if ((n->kind == NODE_STMT) &&
+                (n->element.stmt->statement_kind == STMT_WHILE) &&
+                evaluate(&k, n->child[0], &value) && (value != 0)) {
+            n->element.stmt->enters = true;
+            remark("removed guard of loop in '%s': condition holds on entry",
+                    func->token_str);
+        }
+        learn(&k, n);
+
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            mark_stmts(func, n->child[i]);
+        }
+    }
+
+    free(k.ids);
+    free(k.values);
+}
+
+/**
+ * Update what is known after the statement: `x = e` teaches us x if `e` has
+ * a known value, and otherwise only x is forgotten if `e` has no side
+ * effects. Anything else may have changed anything.
+ */
+static void learn(Known* k, Node* stmt)
+{
+    int value = 0;
+    Node* assign = stmt->child[0];
+    if ((stmt->kind != NODE_STMT) ||
+            (stmt->element.stmt->statement_kind != STMT_EXPR) ||
+            (assign == NULL) || (assign->kind != NODE_EXPR) ||
+            (assign->child[0]->child[0] != NULL) ||
+            is_deref(assign->child[0]) ||
+            has_side_effects(assign->child[1])) {
+        k->num = 0;
+        return;
+    }
+
+    char* id = assign->child[0]->token_str;
+    bool constant = evaluate(k, assign->child[1], &value);
+    for (int i = 0; i < k->num; ++i) {
+        if (!strcmp(k->ids[i], id)) {
+            if (constant) {
+                k->values[i] = value;
+            } else {
+                k->ids[i] = k->ids[--k->num];
+                k->values[i] = k->values[k->num];
+            }
+            return;
+        }
+    }
+    if (!constant) {
+        return;
+    }
+    if (k->num == k->cap) {
+        k->cap = k->cap ? k->cap * 2 : 8;
+        k->ids = realloc(k->ids, sizeof(char*) * k->cap);
+        k->values = realloc(k->values, sizeof(int) * k->cap);
+    }
+    k->ids[k->num] = id;
+    k->values[k->num] = value;
+    k->num += 1;
+}
+
+/**
+ * The value of an expression of constants and known scalars, if it has one
+ * that can be worked out without a trap.
+ */
+static bool evaluate(Known* k, Node* n, int* value)
+{
+    int lhs = 0;
+    int rhs = 0;
+
+    switch (n->kind) {
+        case NODE_FACTOR:
+            *value = atoi(n->token_str);
+            return true;
+        case NODE_VAR:
+            if ((n->child[0] != NULL) || is_deref(n)) {
+                return false;
+            }
+            for (int i = 0; i < k->num; ++i) {
+                if (!strcmp(k->ids[i], n->token_str)) {
+                    *value = k->values[i];
+                    return true;
+                }
+            }
+            return false;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            return evaluate(k, n->child[0], &lhs) &&
+                    evaluate(k, n->child[1], &rhs) &&
+                    evaluate_op(n->token_str, lhs, rhs, value);
+        default:
+            return false;
+    }
+}
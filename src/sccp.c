@@ -0,0 +1,407 @@
+/**
+ * Sparse conditional constant propagation, and copy propagation.
+ *
+ * Each function is put into SSA form (ssa.c), and every name given a value
+ * in the lattice TOP, a constant, or BOTTOM. Values start at TOP and only
+ * ever move down, while blocks only become executable once a branch that
+ * could be taken leads to them. Two worklists drive this: edges newly found
+ * to be executable, and names whose value has changed, whose users are then
+ * revisited. A phi only meets the values on its executable edges, so a
+ * variable assigned a different value on a path that is never taken is
+ * still known to be constant.
+ *
+ * The results are written back into the AST. Uses of constant names become
+ * literals and constant subexpressions are folded, so a branch on a known
+ * condition becomes a branch on a literal for eliminate_dead_code to remove.
+ * A use of a copy reads the original instead, leaving the copy dead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "optimise.h"
+#include "shared.h"
+#include "ssa.h"
+
+typedef enum Level {
+    LEVEL_TOP,
+    LEVEL_CONST,
+    LEVEL_BOTTOM,
+} Level;
+
+typedef struct Value {
+    Level level;
+    int constant;
+} Value;
+
+typedef struct Solver {
+    Ssa* ssa;
+    Value* values;    // By name
+    bool* executable; // Blocks, by id
+    bool** edges;     // Executable edges, by block id and predecessor index
+
+    Block** flow;     // Edges to visit, as pairs of blocks
+    int num_flow;
+    int cap_flow;
+    int* names;       // Names whose value has changed
+    int num_names;
+    int cap_names;
+} Solver;
+
+static void propagate_function(Node* func);
+static void solve(Solver* s);
+static void visit_block(Solver* s, Block* b);
+static void visit(Solver* s, int i);
+static void visit_branch(Solver* s, Inst* inst);
+static void mark_edge(Solver* s, Block* from, Block* to);
+static void set_value(Solver* s, int name, Value value);
+static Value evaluate(Solver* s, Inst* inst, Node* n);
+static Value meet(Value a, Value b);
+static int rewrite(Solver* s, Node* func, int* copies);
+static void replace(Node* n, Node* with);
+static void fold(Node* n);
+
+void propagate_constants(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->element.decl->declaration_kind == DEC_FUNC) {
+            propagate_function(n);
+        }
+    }
+}
+
+/* Private */
+
+static void propagate_function(Node* func)
+{
+    Ssa* ssa = build_ssa(func);
+    int n = ssa->cfg->num_blocks;
+    Solver s = {
+        .ssa = ssa,
+        .values = calloc(sizeof(Value), ssa->num_insts),
+        .executable = calloc(sizeof(bool), n),
+        .edges = calloc(sizeof(bool*), n)
+    };
+    for (int i = 0; i < n; ++i) {
+        s.edges[i] = calloc(sizeof(bool), ssa->num_preds[i] + 1);
+    }
+
+    solve(&s);
+
+    int copies = 0;
+    int constants = rewrite(&s, func, &copies);
+    if (constants > 0) {
+        remark("propagated %d constants in '%s'", constants, func->token_str);
+        count_stat("sccp: constants propagated", constants);
+    }
+    if (copies > 0) {
+        remark("propagated %d copies in '%s'", copies, func->token_str);
+        count_stat("sccp: copies propagated", copies);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        free(s.edges[i]);
+    }
+    free(s.edges);
+    free(s.executable);
+    free(s.values);
+    free(s.flow);
+    free(s.names);
+    free_ssa(ssa);
+}
+
+/**
+ * Run both worklists dry, starting from the entry block.
+ */
+static void solve(Solver* s)
+{
+    Ssa* ssa = s->ssa;
+    for (int i = 0; i < ssa->num_insts; ++i) {
+        if ((ssa->insts[i].kind == INST_ENTRY) ||
+                (ssa->insts[i].kind == INST_OPAQUE)) {
+            s->values[i].level = LEVEL_BOTTOM;
+        }
+    }
+
+    s->executable[ssa->cfg->entry->id] = true;
+    visit_block(s, ssa->cfg->entry);
+
+    while ((s->num_flow > 0) || (s->num_names > 0)) {
+        if (s->num_flow > 0) {
+            s->num_flow -= 2;
+            Block* from = s->flow[s->num_flow];
+            Block* to = s->flow[s->num_flow + 1];
+            int p = pred_index(ssa, to, from);
+            if (s->edges[to->id][p]) {
+                continue;
+            }
+            s->edges[to->id][p] = true;
+
+            if (s->executable[to->id]) {
+                // Only the phis can see the new edge
+                for (int i = 0; i < ssa->num_order[to->id]; ++i) {
+                    int inst = ssa->order[to->id][i];
+                    if (ssa->insts[inst].kind == INST_PHI) {
+                        visit(s, inst);
+                    }
+                }
+            } else {
+                s->executable[to->id] = true;
+                visit_block(s, to);
+            }
+        } else {
+            Inst* inst = &ssa->insts[s->names[--s->num_names]];
+            for (int u = 0; u < inst->num_users; ++u) {
+                int user = inst->users[u];
+                if (s->executable[ssa->insts[user].block->id]) {
+                    visit(s, user);
+                }
+            }
+        }
+    }
+}
+
+static void visit_block(Solver* s, Block* b)
+{
+    Ssa* ssa = s->ssa;
+    for (int i = 0; i < ssa->num_order[b->id]; ++i) {
+        visit(s, ssa->order[b->id][i]);
+    }
+    if (b->branch == NULL) {
+        for (int i = 0; i < b->num_succ; ++i) {
+            mark_edge(s, b, b->succ[i]);
+        }
+    }
+}
+
+static void visit(Solver* s, int i)
+{
+    Inst* inst = &s->ssa->insts[i];
+    Value value = { LEVEL_TOP, 0 };
+
+    switch (inst->kind) {
+        case INST_PHI:
+            for (int p = 0; p < s->ssa->num_preds[inst->block->id]; ++p) {
+                if (s->edges[inst->block->id][p]) {
+                    value = meet(value, s->values[inst->args[p]]);
+                }
+            }
+            set_value(s, i, value);
+            break;
+        case INST_ASSIGN:
+            set_value(s, i, evaluate(s, inst, inst->expr));
+            break;
+        case INST_BRANCH:
+            visit_branch(s, inst);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Mark the edges out of a block that its branch could take. The graph
+ * lists the then or body edge first, and leaves out an edge that a literal
+ * condition can never take.
+ */
+static void visit_branch(Solver* s, Inst* inst)
+{
+    Block* b = inst->block;
+    Value cond = { LEVEL_BOTTOM, 0 };
+    if ((b->branch->element.stmt->statement_kind != STMT_RETURN) &&
+            (inst->expr != NULL)) {
+        cond = evaluate(s, inst, inst->expr);
+    }
+
+    if ((cond.level == LEVEL_CONST) && (b->num_succ == 2)) {
+        mark_edge(s, b, b->succ[cond.constant ? 0 : 1]);
+    } else if (cond.level != LEVEL_TOP) {
+        for (int i = 0; i < b->num_succ; ++i) {
+            mark_edge(s, b, b->succ[i]);
+        }
+    }
+}
+
+static void mark_edge(Solver* s, Block* from, Block* to)
+{
+    if (s->num_flow + 2 > s->cap_flow) {
+        s->cap_flow = s->cap_flow ? s->cap_flow * 2 : 16;
+        s->flow = realloc(s->flow, sizeof(Block*) * s->cap_flow);
+    }
+    s->flow[s->num_flow++] = from;
+    s->flow[s->num_flow++] = to;
+}
+
+/**
+ * Lower the value of a name, queueing its users if it changed.
+ */
+static void set_value(Solver* s, int name, Value value)
+{
+    Value old = s->values[name];
+    value = meet(old, value);
+    if ((value.level == old.level) && (value.constant == old.constant)) {
+        return;
+    }
+
+    s->values[name] = value;
+    if (s->num_names == s->cap_names) {
+        s->cap_names = s->cap_names ? s->cap_names * 2 : 16;
+        s->names = realloc(s->names, sizeof(int) * s->cap_names);
+    }
+    s->names[s->num_names++] = name;
+}
+
+/**
+ * The value of a plain expression, given the values of the names it reads.
+ * Globals, arrays and calls are BOTTOM, as are results that would overflow
+ * or divide by zero.
+ */
+static Value evaluate(Solver* s, Inst* inst, Node* n)
+{
+    Value bottom = { LEVEL_BOTTOM, 0 };
+    Value value = { LEVEL_CONST, 0 };
+    Value lhs = bottom;
+    Value rhs = bottom;
+
+    switch (n->kind) {
+        case NODE_FACTOR:
+            value.constant = atoi(n->token_str);
+            return value;
+        case NODE_VAR:
+            for (int u = 0; u < inst->num_uses; ++u) {
+                Use* use = &s->ssa->uses[inst->first_use + u];
+                if (use->node == n) {
+                    return s->values[use->name];
+                }
+            }
+            return bottom;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            lhs = evaluate(s, inst, n->child[0]);
+            rhs = evaluate(s, inst, n->child[1]);
+            if ((lhs.level == LEVEL_BOTTOM) || (rhs.level == LEVEL_BOTTOM)) {
+                return bottom;
+            }
+            if ((lhs.level == LEVEL_TOP) || (rhs.level == LEVEL_TOP)) {
+                value.level = LEVEL_TOP;
+                return value;
+            }
+            if (!evaluate_op(n->token_str, lhs.constant, rhs.constant,
+                        &value.constant)) {
+                return bottom;
+            }
+            return value;
+        default:
+            return bottom;
+    }
+}
+
+static Value meet(Value a, Value b)
+{
+    if (a.level == LEVEL_TOP) {
+        return b;
+    }
+    if ((b.level == LEVEL_TOP) || ((a.level == LEVEL_CONST) &&
+                (b.level == LEVEL_CONST) && (a.constant == b.constant))) {
+        return a;
+    }
+    return (Value) { LEVEL_BOTTOM, 0 };
+}
+
+/**
+ * Write the results into the executable blocks of the function. Returns the
+ * number of uses that became constants, and stores the number that became
+ * copies in `copies`.
+ */
+static int rewrite(Solver* s, Node* func, int* copies)
+{
+    Ssa* ssa = s->ssa;
+    int constants = 0;
+
+    for (int i = 0; i < ssa->num_insts; ++i) {
+        Inst* inst = &ssa->insts[i];
+        if ((inst->expr == NULL) || !s->executable[inst->block->id]) {
+            continue;
+        }
+
+        for (int u = 0; u < inst->num_uses; ++u) {
+            Use* use = &ssa->uses[inst->first_use + u];
+            Value value = s->values[use->name];
+            if (value.level == LEVEL_CONST) {
+                replace(use->node, new_num(value.constant));
+                constants += 1;
+            } else if (use->copy >= 0) {
+                int var = ssa->insts[use->copy].var;
+                replace(use->node, new_var(ssa->cfg->vars[var]));
+                *copies += 1;
+            }
+        }
+        fold(inst->expr);
+
+        int value = 0;
+        if ((inst->kind == INST_BRANCH) &&
+                (inst->block->branch->element.stmt->statement_kind !=
+                 STMT_RETURN) &&
+                is_const_cond(inst->expr, &value) &&
+                (inst->block->num_succ == 2)) {
+            remark("folded a branch on a constant condition in '%s'",
+                    func->token_str);
+            count_stat("sccp: branches folded", 1);
+        }
+    }
+    return constants;
+}
+
+/**
+ * Overwrite a node in place, keeping its place in any list.
+ */
+static void replace(Node* n, Node* with)
+{
+    Node* sibling = n->sibling;
+    *n = *with;
+    n->sibling = sibling;
+}
+
+/**
+ * Fold operators whose operands are both literals, from the leaves up.
+ */
+static void fold(Node* n)
+{
+    int value = 0;
+    if (n == NULL) {
+        return;
+    }
+
+    switch (n->kind) {
+        case NODE_EXPR:
+            fold(n->child[0]->child[0]);
+            fold(n->child[1]);
+            break;
+        case NODE_VAR:
+            fold(n->child[0]);
+            break;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            fold(n->child[0]);
+            fold(n->child[1]);
+            if ((n->child[0]->kind == NODE_FACTOR) &&
+                    (n->child[1]->kind == NODE_FACTOR) &&
+                    evaluate_op(n->token_str, atoi(n->child[0]->token_str),
+                        atoi(n->child[1]->token_str), &value)) {
+                replace(n, new_num(value));
+            }
+            break;
+        case NODE_CALL:
+            for (Node* arg = n->child[0]; arg != NULL; arg = arg->sibling) {
+                fold(arg);
+            }
+            break;
+        default:
+            break;
+    }
+}
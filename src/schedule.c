@@ -0,0 +1,419 @@
+/**
+ * Instruction scheduling for a MIPS with branch and load delay slots.
+ *
+ * This runs over the assembly that cgen has written, as it is the only
+ * place every instruction of a block can be seen together. Labels,
+ * directives and branches divide the text into basic blocks, and each block
+ * is list scheduled: instructions are issued in an order that respects
+ * their dependences on registers, HI and LO, and memory, preferring those
+ * already ready once the latency of what they depend on has passed, then
+ * those on the longest path to the end of the block.
+ *
+ * A load's result cannot be used by the instruction after it, so when
+ * nothing else can go there the scheduler fills the gap with a nop. The
+ * instruction after a branch or jump always runs, so the delay slot is
+ * filled with an instruction from before the branch that it does not
+ * depend on, or a nop if there isn't one. A load is never moved into a
+ * slot, as the instruction after it would then be at the branch target.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "schedule.h"
+#include "shared.h"
+
+#define MAX_LINE 256
+
+// Candidates tried for each delay slot, nearest the branch first
+#define MAX_FILLERS 8
+
+// HI and LO are tracked after the 32 general registers
+#define REG_HI 32
+#define REG_LO 33
+
+typedef uint64_t RegSet;
+
+typedef struct Inst {
+    char* text;     // The line as cgen wrote it
+    RegSet defs;
+    RegSet uses;
+    int latency;    // Cycles until a result can be used without stalling
+    bool load;
+    bool store;
+    bool branch;
+    bool barrier;   // Ordered against everything: a syscall, or unknown
+} Inst;
+
+typedef struct Scheduler {
+    FILE* out;
+
+    Inst* body;     // The current block, less its branch
+    int num_body;
+    int cap_body;
+
+    RegSet loaded;  // Written by the load last emitted, if it was one
+} Scheduler;
+
+static char* reg_names[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+static Inst decode(char* line);
+static RegSet operand_regs(char* operand);
+static bool is_op(char* op, char** ops);
+static void flush(Scheduler* s, Inst* branch);
+static bool depends(Inst* a, Inst* b);
+static bool can_fill(Scheduler* s, int i, Inst* branch);
+static int cost(Scheduler* s, int* order, int len, Inst* branch, int filler);
+static int list_schedule(Scheduler* s, int skip, int* order);
+static char* copy_line(char* line);
+
+void schedule(FILE* in, FILE* out)
+{
+    Scheduler s = { .out = out };
+    char line[MAX_LINE];
+
+    while (fgets(line, MAX_LINE, in) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char* start = line + strspn(line, " \t");
+        size_t len = strlen(start);
+
+        if ((len == 0) || (start[0] == '.') || (start[len - 1] == ':')) {
+            // A label may be jumped to, so it starts a new block
+            flush(&s, NULL);
+            fprintf(out, "%s\n", line);
+            continue;
+        }
+
+        Inst inst = decode(copy_line(line));
+        if (inst.branch) {
+            flush(&s, &inst);
+            free(inst.text);
+            continue;
+        }
+        if (s.num_body == s.cap_body) {
+            s.cap_body = s.cap_body ? s.cap_body * 2 : 32;
+            s.body = realloc(s.body, sizeof(Inst) * s.cap_body);
+        }
+        s.body[s.num_body++] = inst;
+    }
+    flush(&s, NULL);
+    free(s.body);
+}
+
+/* Private */
+
+/**
+ * Work out what an instruction reads and writes from its operands. Those
+ * the scheduler doesn't know are kept in place.
+ */
+static Inst decode(char* line)
+{
+    static char* loads[] = { "lw", NULL };
+    static char* stores[] = { "sw", NULL };
+    static char* branches[] = {
+        "b", "j", "jr", "jal", "beq", "bne", "blt", "ble", "bgt", "bge",
+        "bltz", "blez", "bgtz", "bgez", "beqz", "bnez", NULL
+    };
+    static char* alu[] = {
+        "add", "addu", "sub", "subu", "addi", "addiu", "and", "or", "xor",
+        "nor", "slt", "sltu", "slti", "sltiu", "andi", "ori", "xori", "sll",
+        "srl", "sra", "sllv", "srlv", "srav", "mul", "move", "li", "la",
+        "lui", "neg", "not", NULL
+    };
+
+    Inst inst = { .text = line, .latency = 1 };
+    char buffer[MAX_LINE];
+    strcpy(buffer, line);
+
+    char* operands[4] = { NULL };
+    int num = 0;
+    char* op = strtok(buffer, " \t,");
+    char* token = NULL;
+    while ((num < 4) && ((token = strtok(NULL, " \t,")) != NULL)) {
+        operands[num++] = token;
+    }
+
+    if (op == NULL) {
+        inst.barrier = true;
+    } else if (is_op(op, loads) && (num == 2)) {
+        inst.load = true;
+        inst.latency = 2;
+        inst.defs = operand_regs(operands[0]);
+        inst.uses = operand_regs(operands[1]);
+    } else if (is_op(op, stores) && (num == 2)) {
+        inst.store = true;
+        inst.uses = operand_regs(operands[0]) | operand_regs(operands[1]);
+    } else if (is_op(op, branches)) {
+        inst.branch = true;
+        for (int i = 0; i < num; ++i) {
+            inst.uses |= operand_regs(operands[i]);
+        }
+        if (!strcmp(op, "jal")) {
+            inst.defs = (RegSet) 1 << 31;
+        }
+    } else if ((!strcmp(op, "div") || !strcmp(op, "mult")) && (num == 2)) {
+        inst.latency = strcmp(op, "div") ? 4 : 12;
+        inst.defs = ((RegSet) 1 << REG_HI) | ((RegSet) 1 << REG_LO);
+        inst.uses = operand_regs(operands[0]) | operand_regs(operands[1]);
+    } else if ((!strcmp(op, "mflo") || !strcmp(op, "mfhi")) && (num == 1)) {
+        inst.defs = operand_regs(operands[0]);
+        inst.uses = (RegSet) 1 << (!strcmp(op, "mflo") ? REG_LO : REG_HI);
+    } else if (is_op(op, alu) && (num >= 2)) {
+        inst.latency = strcmp(op, "mul") ? 1 : 4;
+        inst.defs = operand_regs(operands[0]);
+        for (int i = 1; i < num; ++i) {
+            inst.uses |= operand_regs(operands[i]);
+        }
+    } else if (!strcmp(op, "syscall")) {
+        inst.barrier = true;
+        inst.defs = (RegSet) 1 << 2;
+        inst.uses = ((RegSet) 1 << 2) | ((RegSet) 1 << 4);
+    } else {
+        inst.barrier = true;
+    }
+
+    // $zero is never really written, so orders nothing
+    inst.defs &= ~(RegSet) 1;
+    inst.uses &= ~(RegSet) 1;
+    return inst;
+}
+
+/**
+ * The register an operand names, or the base register of a memory operand
+ * such as `-8($fp)`. Immediates and labels name none.
+ */
+static RegSet operand_regs(char* operand)
+{
+    char name[MAX_LINE];
+    char* open = strchr(operand, '(');
+    if (open != NULL) {
+        strcpy(name, open + 1);
+        name[strcspn(name, ")")] = '\0';
+    } else {
+        strcpy(name, operand);
+    }
+
+    for (int i = 0; i < 32; ++i) {
+        if (!strcmp(name, reg_names[i])) {
+            return (RegSet) 1 << i;
+        }
+    }
+    return 0;
+}
+
+static bool is_op(char* op, char** ops)
+{
+    for (int i = 0; ops[i] != NULL; ++i) {
+        if (!strcmp(op, ops[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Schedule and write out the current block, ending with `branch` and its
+ * delay slot if there is one. Each instruction that could fill the slot is
+ * tried, and the one that leaves the fewest nops is kept.
+ */
+static void flush(Scheduler* s, Inst* branch)
+{
+    int n = s->num_body;
+    int* order = malloc(sizeof(int) * (2 * n + 1));
+    int* best = malloc(sizeof(int) * (2 * n + 1));
+
+    int filler = -1;
+    int best_len = list_schedule(s, -1, order);
+    int best_cost = cost(s, order, best_len, branch, -1);
+    memcpy(best, order, sizeof(int) * best_len);
+
+    int tried = 0;
+    for (int i = n - 1; (i >= 0) && (branch != NULL) &&
+            (tried < MAX_FILLERS); --i) {
+        if (!can_fill(s, i, branch)) {
+            continue;
+        }
+        tried += 1;
+        int len = list_schedule(s, i, order);
+        if (cost(s, order, len, branch, i) < best_cost) {
+            best_cost = cost(s, order, len, branch, i);
+            best_len = len;
+            filler = i;
+            memcpy(best, order, sizeof(int) * len);
+        }
+    }
+
+    for (int i = 0; i < best_len; ++i) {
+        if (best[i] < 0) {
+            fprintf(s->out, "nop\n");
+            s->loaded = 0;
+        } else {
+            Inst* inst = &s->body[best[i]];
+            fprintf(s->out, "%s\n", inst->text);
+            s->loaded = inst->load ? inst->defs : 0;
+        }
+    }
+
+    if (branch != NULL) {
+        if ((branch->uses | branch->defs) & s->loaded) {
+            fprintf(s->out, "nop\n");
+        }
+        fprintf(s->out, "%s\n", branch->text);
+        if (filler >= 0) {
+            fprintf(s->out, "%s\n", s->body[filler].text);
+        } else {
+            fprintf(s->out, "nop\n");
+        }
+        s->loaded = 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        free(s->body[i].text);
+    }
+    s->num_body = 0;
+    free(order);
+    free(best);
+}
+
+/**
+ * The nops a schedule needs: those within it, one before the branch if it
+ * reads what the last instruction loads, and one in the delay slot unless
+ * `filler` goes there.
+ */
+static int cost(Scheduler* s, int* order, int len, Inst* branch, int filler)
+{
+    int nops = 0;
+    for (int i = 0; i < len; ++i) {
+        nops += order[i] < 0;
+    }
+    if (branch == NULL) {
+        return nops;
+    }
+
+    RegSet loaded = s->loaded;
+    if (len > 0) {
+        loaded = ((order[len - 1] >= 0) && s->body[order[len - 1]].load) ?
+                s->body[order[len - 1]].defs : 0;
+    }
+    if ((branch->uses | branch->defs) & loaded) {
+        nops += 1;
+    }
+    return nops + (filler < 0);
+}
+
+/**
+ * True if `b`, coming after `a`, must stay after it.
+ */
+static bool depends(Inst* a, Inst* b)
+{
+    return a->barrier || b->barrier ||
+            (a->defs & (b->uses | b->defs)) || (a->uses & b->defs) ||
+            (a->store && (b->load || b->store)) || (a->load && b->store);
+}
+
+/**
+ * True if the instruction could be moved into the branch's delay slot:
+ * nothing after it in the block depends on it, and the branch neither
+ * depends on it nor changes what it reads.
+ */
+static bool can_fill(Scheduler* s, int i, Inst* branch)
+{
+    Inst* inst = &s->body[i];
+    if (inst->load || inst->barrier) {
+        return false;
+    }
+    for (int j = i + 1; j < s->num_body; ++j) {
+        if (depends(inst, &s->body[j])) {
+            return false;
+        }
+    }
+    return !(inst->defs & (branch->uses | branch->defs)) &&
+            !(inst->uses & branch->defs);
+}
+
+/**
+ * List schedule the block, leaving out `skip` if it is not -1. The order is
+ * stored as body indices, with -1 for a nop, and its length returned.
+ */
+static int list_schedule(Scheduler* s, int skip, int* order)
+{
+    int n = s->num_body;
+    int* height = calloc(sizeof(int), n + 1);
+    int* issued = malloc(sizeof(int) * (n + 1));
+    int len = 0;
+
+    // The longest path from each instruction to the end of the block
+    for (int i = n - 1; i >= 0; --i) {
+        height[i] = s->body[i].latency;
+        for (int j = i + 1; j < n; ++j) {
+            if ((j != skip) && depends(&s->body[i], &s->body[j]) &&
+                    (s->body[i].latency + height[j] > height[i])) {
+                height[i] = s->body[i].latency + height[j];
+            }
+        }
+        issued[i] = -1;
+    }
+
+    RegSet loaded = s->loaded;
+    int remaining = n - ((skip >= 0) ? 1 : 0);
+    while (remaining > 0) {
+        int pick = -1;
+        int pick_stall = 0;
+        for (int i = 0; i < n; ++i) {
+            if ((i == skip) || (issued[i] >= 0) ||
+                    ((s->body[i].uses | s->body[i].defs) & loaded)) {
+                continue;
+            }
+
+            bool ready = true;
+            int stall = 0;
+            for (int j = 0; (j < i) && ready; ++j) {
+                if ((j == skip) || !depends(&s->body[j], &s->body[i])) {
+                    continue;
+                }
+                if (issued[j] < 0) {
+                    ready = false;
+                } else if (issued[j] + s->body[j].latency - len > stall) {
+                    stall = issued[j] + s->body[j].latency - len;
+                }
+            }
+            if (!ready) {
+                continue;
+            }
+
+            if ((pick < 0) || (stall < pick_stall) ||
+                    ((stall == pick_stall) && (height[i] > height[pick]))) {
+                pick = i;
+                pick_stall = stall;
+            }
+        }
+
+        if (pick < 0) {
+            order[len++] = -1;
+            loaded = 0;
+            continue;
+        }
+        order[len] = pick;
+        issued[pick] = len++;
+        loaded = s->body[pick].load ? s->body[pick].defs : 0;
+        remaining -= 1;
+    }
+
+    free(height);
+    free(issued);
+    return len;
+}
+
+static char* copy_line(char* line)
+{
+    char* copy = malloc(strlen(line) + 1);
+    strcpy(copy, line);
+    return copy;
+}
@@ -0,0 +1,10 @@
+/**
+ * Instruction scheduling for a MIPS with branch and load delay slots.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+/* Function Prototypes */
+void schedule(FILE* in, FILE* out);
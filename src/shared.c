@@ -1,3 +1,6 @@
+#include <stdarg.h>
+#include <string.h>
+
 #include "shared.h"
 
 const char* TOKEN_STRINGS[] = {
@@ -13,6 +16,32 @@ const char* TOKEN_STRINGS[] = {
     "NUM", "ID"
 };
 
+Options options = {
+    .level = 2,
+    .passes = NULL,
+    .time_passes = false,
+    .dump_passes = false,
+    .inline_threshold = 16,
+    .unroll = 4,
+    .unroll_limit = 64,
+    .small_data = 8,
+    .delay_slots = false,
+    .omit_fp = false,
+    .whole_program = false,
+    .profile_generate = false,
+    .profile_use = NULL,
+    .remarks = false,
+    .stats = false
+};
+
+typedef struct Stat {
+    const char* name;
+    int count;
+} Stat;
+
+static Stat stats[MAX_STATS];
+static int num_stats = 0;
+
 
 /**
  * Source:
@@ -55,3 +84,51 @@ struct String read_whole_file(const char* filename)
         .size = fsize
     };
 }
+
+/**
+ * Print an optimisation remark to stderr, if they were asked for.
+ */
+void remark(const char* format, ...)
+{
+    if (!options.remarks) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "remark: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/**
+ * Add to a named count, reported by print_stats.
+ */
+void count_stat(const char* name, int n)
+{
+    for (int i = 0; i < num_stats; ++i) {
+        if (!strcmp(stats[i].name, name)) {
+            stats[i].count += n;
+            return;
+        }
+    }
+    if (num_stats < MAX_STATS) {
+        stats[num_stats++] = (Stat) { .name = name, .count = n };
+    }
+}
+
+/**
+ * Print the counts to stderr, in the order they were first added, if they
+ * were asked for.
+ */
+void print_stats(void)
+{
+    if (!options.stats) {
+        return;
+    }
+
+    for (int i = 0; i < num_stats; ++i) {
+        fprintf(stderr, "%8d %s\n", stats[i].count, stats[i].name);
+    }
+}
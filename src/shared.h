@@ -1,9 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define MAX_TOKEN_SIZE 20
+#define MAX_STATS 32
 
 enum Error {
     ARGC_ERROR = 1,
@@ -75,7 +77,29 @@ struct String {
     uint64_t size;
 };
 
+typedef struct Options {
+    int level;             // Optimisation level, 0 to 2, picking a pipeline
+    char* passes;          // Comma-separated passes to run instead, or NULL
+    bool time_passes;      // Report the time each pass takes on stderr
+    bool dump_passes;      // Dump the tree after each pass on stderr
+    int inline_threshold;  // Largest callee cost to inline, 0 disables
+    int unroll;            // Copies of a counted loop's body, below 2 disables
+    int unroll_limit;      // Largest unrolled body, in nodes
+    int small_data;        // Largest global addressed from $gp, in bytes
+    bool delay_slots;      // Schedule for branch and load delay slots
+    bool omit_fp;          // Address frames from $sp, leaving $fp free
+    bool whole_program;    // No outside code calls ours; return in $a0
+    bool profile_generate; // Count runs of each block, printed on exit
+    char* profile_use;     // Output of a profiled run to optimise with
+    bool remarks;          // Report optimisation decisions on stderr
+    bool stats;            // Report optimisation counts on stderr
+} Options;
+
 extern const char* TOKEN_STRINGS[];
+extern Options options;
 
 /* Functions */
 struct String read_whole_file(const char* filename);
+void remark(const char* format, ...);
+void count_stat(const char* name, int n);
+void print_stats(void);
@@ -0,0 +1,550 @@
+/**
+ * Static single assignment form over a single function.
+ *
+ * The form is an overlay on the function's control flow graph rather than a
+ * separate copy of the program: every instruction points back at the part of
+ * the AST it stands for, so a pass can analyse the SSA names and then rewrite
+ * the statements in place, leaving cgen to emit them as before.
+ *
+ * Tracked variables, the scalar locals and parameters, are promoted to SSA
+ * names: each gets a name on entry, another at each assignment, and phis are
+ * placed at the iterated dominance frontiers of the blocks that assign it.
+ * Names are then given to every use by walking the dominator tree.
+ *
+ * Only plain statements, with no nested assignment and no inlined body, are
+ * modelled in detail. Anything else writes the variables it assigns with an
+ * opaque value, and its own uses are left unnamed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "shared.h"
+#include "ssa.h"
+
+typedef struct Renamer {
+    int** stacks;  // The names of each variable currently in scope
+    int* heights;
+    int* caps;
+
+    int* pushed;   // Variables in the order their names were pushed
+    int num_pushed;
+    int cap_pushed;
+} Renamer;
+
+static void find_preds(Ssa* ssa);
+static void find_idoms(Ssa* ssa);
+static bool* find_frontiers(Ssa* ssa);
+static void place_phis(Ssa* ssa, bool* frontiers);
+static void mark_defs(Cfg* cfg, Node* n, bool* defs);
+static void rename_block(Ssa* ssa, Renamer* r, Block* b);
+static void rename_stmt(Ssa* ssa, Renamer* r, Block* b, Node* e);
+static void rename_branch(Ssa* ssa, Renamer* r, Block* b);
+static void write_opaque(Ssa* ssa, Renamer* r, Block* b, Node* n);
+static void add_uses(Ssa* ssa, Renamer* r, int inst, Node* n);
+static int new_inst(Ssa* ssa, InstKind kind, Block* b, int var, Node* expr);
+static void add_user(Ssa* ssa, int name, int user);
+static void push_name(Renamer* r, int var, int name);
+static int top_name(Renamer* r, int var);
+static bool is_tracked(Cfg* cfg, Node* var, int* v);
+static bool is_plain(Node* n);
+
+/**
+ * Build the SSA form of a function declaration.
+ */
+Ssa* build_ssa(Node* func)
+{
+    Ssa* ssa = calloc(sizeof(Ssa), 1);
+    ssa->cfg = build_cfg(func);
+    compute_dominators(ssa->cfg);
+
+    Cfg* cfg = ssa->cfg;
+    int n = cfg->num_blocks;
+    ssa->order = calloc(sizeof(int*), n);
+    ssa->num_order = calloc(sizeof(int), n);
+    ssa->cap_order = calloc(sizeof(int), n);
+
+    find_preds(ssa);
+    find_idoms(ssa);
+    bool* frontiers = find_frontiers(ssa);
+    place_phis(ssa, frontiers);
+    free(frontiers);
+
+    Renamer r = {
+        .stacks = calloc(sizeof(int*), cfg->num_vars),
+        .heights = calloc(sizeof(int), cfg->num_vars),
+        .caps = calloc(sizeof(int), cfg->num_vars)
+    };
+    for (int v = 0; v < cfg->num_vars; ++v) {
+        push_name(&r, v, new_inst(ssa, INST_ENTRY, cfg->entry, v, NULL));
+    }
+    rename_block(ssa, &r, cfg->entry);
+
+    for (int v = 0; v < cfg->num_vars; ++v) {
+        free(r.stacks[v]);
+    }
+    free(r.stacks);
+    free(r.heights);
+    free(r.caps);
+    free(r.pushed);
+
+    // Chain every name to the instructions that read it
+    for (int i = 0; i < ssa->num_insts; ++i) {
+        Inst* inst = &ssa->insts[i];
+        for (int u = 0; u < inst->num_uses; ++u) {
+            add_user(ssa, ssa->uses[inst->first_use + u].name, i);
+        }
+        if (inst->kind == INST_PHI) {
+            for (int p = 0; p < ssa->num_preds[inst->block->id]; ++p) {
+                add_user(ssa, inst->args[p], i);
+            }
+        }
+    }
+
+    return ssa;
+}
+
+void free_ssa(Ssa* ssa)
+{
+    for (int i = 0; i < ssa->num_insts; ++i) {
+        free(ssa->insts[i].args);
+        free(ssa->insts[i].users);
+    }
+    for (int i = 0; i < ssa->cfg->num_blocks; ++i) {
+        free(ssa->preds[i]);
+        free(ssa->order[i]);
+    }
+    free(ssa->preds);
+    free(ssa->num_preds);
+    free(ssa->idom);
+    free(ssa->order);
+    free(ssa->num_order);
+    free(ssa->cap_order);
+    free(ssa->insts);
+    free(ssa->uses);
+    free_cfg(ssa->cfg);
+    free(ssa);
+}
+
+/**
+ * Position of `pred` among the predecessors of `b`, which is also the
+ * position of the argument it passes to each of b's phis.
+ */
+int pred_index(Ssa* ssa, Block* b, Block* pred)
+{
+    for (int i = 0; i < ssa->num_preds[b->id]; ++i) {
+        if (ssa->preds[b->id][i] == pred) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Private */
+
+static void find_preds(Ssa* ssa)
+{
+    Cfg* cfg = ssa->cfg;
+    ssa->preds = calloc(sizeof(Block**), cfg->num_blocks);
+    ssa->num_preds = calloc(sizeof(int), cfg->num_blocks);
+
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        if (!b->reachable) {
+            continue;
+        }
+        for (int s = 0; s < b->num_succ; ++s) {
+            int id = b->succ[s]->id;
+            ssa->preds[id] = realloc(ssa->preds[id],
+                    sizeof(Block*) * (ssa->num_preds[id] + 1));
+            ssa->preds[id][ssa->num_preds[id]++] = b;
+        }
+    }
+}
+
+/**
+ * The immediate dominator of a block is the closest of its other
+ * dominators, which is the one dominated by all the rest.
+ */
+static void find_idoms(Ssa* ssa)
+{
+    Cfg* cfg = ssa->cfg;
+    int n = cfg->num_blocks;
+    int* sizes = calloc(sizeof(int), n);
+    ssa->idom = calloc(sizeof(Block*), n);
+
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            sizes[i] += cfg->blocks[i]->dom[j];
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        Block* b = cfg->blocks[i];
+        if (!b->reachable || (b == cfg->entry)) {
+            continue;
+        }
+        for (int d = 0; d < n; ++d) {
+            if ((d != i) && b->dom[d] && ((ssa->idom[i] == NULL) ||
+                        (sizes[d] > sizes[ssa->idom[i]->id]))) {
+                ssa->idom[i] = cfg->blocks[d];
+            }
+        }
+    }
+    free(sizes);
+}
+
+/**
+ * Dominance frontiers, as an n by n matrix: a join is in the frontier of
+ * each block on the way up the dominator tree from one of its predecessors
+ * to its immediate dominator.
+ */
+static bool* find_frontiers(Ssa* ssa)
+{
+    int n = ssa->cfg->num_blocks;
+    bool* frontiers = calloc(sizeof(bool), n * n);
+
+    for (int i = 0; i < n; ++i) {
+        if (ssa->num_preds[i] < 2) {
+            continue;
+        }
+        for (int p = 0; p < ssa->num_preds[i]; ++p) {
+            for (Block* runner = ssa->preds[i][p];
+                    runner != ssa->idom[i];
+                    runner = ssa->idom[runner->id]) {
+                frontiers[runner->id * n + i] = true;
+            }
+        }
+    }
+    return frontiers;
+}
+
+/**
+ * Place a phi for each variable at the iterated dominance frontier of the
+ * blocks that assign it, the entry included.
+ */
+static void place_phis(Ssa* ssa, bool* frontiers)
+{
+    Cfg* cfg = ssa->cfg;
+    int n = cfg->num_blocks;
+    bool* defs = calloc(sizeof(bool), n * cfg->num_vars);
+
+    for (int i = 0; i < n; ++i) {
+        Block* b = cfg->blocks[i];
+        if (!b->reachable) {
+            continue;
+        }
+        bool* block_defs = &defs[i * cfg->num_vars];
+        for (int s = 0; s < b->num_stmts; ++s) {
+            mark_defs(cfg, b->stmts[s]->child[0], block_defs);
+        }
+        if (b->branch != NULL) {
+            mark_defs(cfg, b->branch->child[0], block_defs);
+        }
+    }
+
+    Block** work = malloc(sizeof(Block*) * n);
+    bool* queued = malloc(sizeof(bool) * n);
+    bool* placed = malloc(sizeof(bool) * n);
+    for (int v = 0; v < cfg->num_vars; ++v) {
+        int num_work = 0;
+        for (int i = 0; i < n; ++i) {
+            queued[i] = (cfg->blocks[i] == cfg->entry) ||
+                    defs[i * cfg->num_vars + v];
+            placed[i] = false;
+            if (queued[i]) {
+                work[num_work++] = cfg->blocks[i];
+            }
+        }
+
+        while (num_work > 0) {
+            Block* w = work[--num_work];
+            for (int d = 0; d < n; ++d) {
+                if (!frontiers[w->id * n + d] || placed[d]) {
+                    continue;
+                }
+                placed[d] = true;
+                int phi = new_inst(ssa, INST_PHI, cfg->blocks[d], v, NULL);
+                ssa->insts[phi].args = malloc(sizeof(int) * ssa->num_preds[d]);
+                if (!queued[d]) {
+                    queued[d] = true;
+                    work[num_work++] = cfg->blocks[d];
+                }
+            }
+        }
+    }
+
+    free(work);
+    free(queued);
+    free(placed);
+    free(defs);
+}
+
+/**
+ * Mark the tracked variables that an expression assigns, anywhere within it.
+ */
+static void mark_defs(Cfg* cfg, Node* n, bool* defs)
+{
+    int v = -1;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_EXPR) && is_tracked(cfg, n->child[0], &v)) {
+            defs[v] = true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            mark_defs(cfg, n->child[i], defs);
+        }
+    }
+}
+
+/**
+ * Name the definitions and uses of a block, fill in the arguments it passes
+ * to the phis of its successors, then do the same for the blocks that it
+ * immediately dominates. Names pushed here go out of scope on return.
+ */
+static void rename_block(Ssa* ssa, Renamer* r, Block* b)
+{
+    Cfg* cfg = ssa->cfg;
+    int pushed = r->num_pushed;
+
+    for (int i = 0; i < ssa->num_order[b->id]; ++i) {
+        int phi = ssa->order[b->id][i];
+        if (ssa->insts[phi].kind == INST_PHI) {
+            push_name(r, ssa->insts[phi].var, phi);
+        }
+    }
+    for (int s = 0; s < b->num_stmts; ++s) {
+        rename_stmt(ssa, r, b, b->stmts[s]->child[0]);
+    }
+    if (b->branch != NULL) {
+        rename_branch(ssa, r, b);
+    }
+
+    for (int s = 0; s < b->num_succ; ++s) {
+        Block* succ = b->succ[s];
+        int p = pred_index(ssa, succ, b);
+        for (int i = 0; i < ssa->num_order[succ->id]; ++i) {
+            Inst* phi = &ssa->insts[ssa->order[succ->id][i]];
+            if (phi->kind == INST_PHI) {
+                phi->args[p] = top_name(r, phi->var);
+            }
+        }
+    }
+
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        if (ssa->idom[i] == b) {
+            rename_block(ssa, r, cfg->blocks[i]);
+        }
+    }
+
+    while (r->num_pushed > pushed) {
+        r->heights[r->pushed[--r->num_pushed]] -= 1;
+    }
+}
+
+static void rename_stmt(Ssa* ssa, Renamer* r, Block* b, Node* e)
+{
+    int v = -1;
+    if (e == NULL) {
+        return;
+    }
+
+    bool plain = (e->kind == NODE_EXPR) ?
+            is_plain(e->child[0]->child[0]) && is_plain(e->child[1]) :
+            is_plain(e);
+    if (!plain) {
+        write_opaque(ssa, r, b, e);
+    } else if ((e->kind == NODE_EXPR) &&
+            is_tracked(ssa->cfg, e->child[0], &v)) {
+        int def = new_inst(ssa, INST_ASSIGN, b, v, e->child[1]);
+        add_uses(ssa, r, def, e->child[1]);
+
+        // `x = y` copies y's value, or whatever y was itself a copy of if
+        // that is still in scope
+        Node* rhs = e->child[1];
+        int src = -1;
+        if (is_tracked(ssa->cfg, rhs, &src)) {
+            int name = ssa->uses[ssa->insts[def].first_use].name;
+            int root = ssa->insts[name].source;
+            ssa->insts[def].source = ((root >= 0) &&
+                    (top_name(r, ssa->insts[root].var) == root)) ?
+                    root : name;
+        }
+        push_name(r, v, def);
+    } else {
+        int effect = new_inst(ssa, INST_EFFECT, b, -1, e);
+        add_uses(ssa, r, effect, e);
+    }
+}
+
+static void rename_branch(Ssa* ssa, Renamer* r, Block* b)
+{
+    Node* cond = b->branch->child[0];
+    if (is_plain(cond)) {
+        int branch = new_inst(ssa, INST_BRANCH, b, -1, cond);
+        add_uses(ssa, r, branch, cond);
+    } else {
+        write_opaque(ssa, r, b, cond);
+        new_inst(ssa, INST_BRANCH, b, -1, NULL);
+    }
+}
+
+/**
+ * Give every tracked variable that the expression assigns a new name with an
+ * unknown value. Inlined bodies are included.
+ */
+static void write_opaque(Ssa* ssa, Renamer* r, Block* b, Node* n)
+{
+    int v = -1;
+    for (; n != NULL; n = n->sibling) {
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            write_opaque(ssa, r, b, n->child[i]);
+        }
+        if ((n->kind == NODE_EXPR) && is_tracked(ssa->cfg, n->child[0], &v)) {
+            push_name(r, v, new_inst(ssa, INST_OPAQUE, b, v, NULL));
+        }
+    }
+}
+
+/**
+ * Name each read of a tracked variable in a plain expression. A copy is
+ * noted where the name it copies is still the current one.
+ */
+static void add_uses(Ssa* ssa, Renamer* r, int inst, Node* n)
+{
+    int v = -1;
+    if (n == NULL) {
+        return;
+    }
+
+    switch (n->kind) {
+        case NODE_VAR:
+            if (!is_tracked(ssa->cfg, n, &v)) {
+                add_uses(ssa, r, inst, n->child[0]);
+                break;
+            }
+            if (ssa->num_uses == ssa->cap_uses) {
+                ssa->cap_uses = ssa->cap_uses ? ssa->cap_uses * 2 : 32;
+                ssa->uses = realloc(ssa->uses, sizeof(Use) * ssa->cap_uses);
+            }
+            Use* use = &ssa->uses[ssa->num_uses++];
+            use->node = n;
+            use->name = top_name(r, v);
+            use->copy = ssa->insts[use->name].source;
+            if ((use->copy >= 0) &&
+                    (top_name(r, ssa->insts[use->copy].var) != use->copy)) {
+                use->copy = -1;
+            }
+            ssa->insts[inst].num_uses += 1;
+            break;
+        case NODE_EXPR:
+            add_uses(ssa, r, inst, n->child[0]->child[0]);
+            add_uses(ssa, r, inst, n->child[1]);
+            break;
+        case NODE_SEXPR:
+        case NODE_ADDIT:
+        case NODE_TERM:
+            add_uses(ssa, r, inst, n->child[0]);
+            add_uses(ssa, r, inst, n->child[1]);
+            break;
+        case NODE_CALL:
+            for (Node* arg = n->child[0]; arg != NULL; arg = arg->sibling) {
+                add_uses(ssa, r, inst, arg);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Append an instruction to its block, returning its index, which is also
+ * the SSA name of the value it defines.
+ */
+static int new_inst(Ssa* ssa, InstKind kind, Block* b, int var, Node* expr)
+{
+    if (ssa->num_insts == ssa->cap_insts) {
+        ssa->cap_insts = ssa->cap_insts ? ssa->cap_insts * 2 : 32;
+        ssa->insts = realloc(ssa->insts, sizeof(Inst) * ssa->cap_insts);
+    }
+    int i = ssa->num_insts++;
+    ssa->insts[i] = (Inst) {
+        .kind = kind,
+        .block = b,
+        .var = var,
+        .expr = expr,
+        .first_use = ssa->num_uses,
+        .source = -1
+    };
+
+    int id = b->id;
+    if (ssa->num_order[id] == ssa->cap_order[id]) {
+        ssa->cap_order[id] = ssa->cap_order[id] ? ssa->cap_order[id] * 2 : 8;
+        ssa->order[id] = realloc(ssa->order[id],
+                sizeof(int) * ssa->cap_order[id]);
+    }
+    ssa->order[id][ssa->num_order[id]++] = i;
+    return i;
+}
+
+static void add_user(Ssa* ssa, int name, int user)
+{
+    Inst* inst = &ssa->insts[name];
+    if (inst->num_users == inst->cap_users) {
+        inst->cap_users = inst->cap_users ? inst->cap_users * 2 : 4;
+        inst->users = realloc(inst->users, sizeof(int) * inst->cap_users);
+    }
+    inst->users[inst->num_users++] = user;
+}
+
+static void push_name(Renamer* r, int var, int name)
+{
+    if (r->heights[var] == r->caps[var]) {
+        r->caps[var] = r->caps[var] ? r->caps[var] * 2 : 4;
+        r->stacks[var] = realloc(r->stacks[var], sizeof(int) * r->caps[var]);
+    }
+    r->stacks[var][r->heights[var]++] = name;
+
+    if (r->num_pushed == r->cap_pushed) {
+        r->cap_pushed = r->cap_pushed ? r->cap_pushed * 2 : 32;
+        r->pushed = realloc(r->pushed, sizeof(int) * r->cap_pushed);
+    }
+    r->pushed[r->num_pushed++] = var;
+}
+
+static int top_name(Renamer* r, int var)
+{
+    return r->stacks[var][r->heights[var] - 1];
+}
+
+/**
+ * True if the node is a plain reference to a tracked scalar, whose index is
+ * stored in `v`.
+ */
+static bool is_tracked(Cfg* cfg, Node* var, int* v)
+{
+    return (var->kind == NODE_VAR) && (var->child[0] == NULL) &&
+            !is_deref(var) && ((*v = find_var(cfg, var->token_str)) >= 0);
+}
+
+/**
+ * True if the expression has no nested assignment and no inlined body, so
+ * that it is evaluated straight through.
+ */
+static bool is_plain(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_EXPR) || ((n->kind == NODE_CALL) &&
+                    (n->element.call->call_kind == CALL_INLINE))) {
+            return false;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (!is_plain(n->child[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
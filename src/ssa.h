@@ -0,0 +1,68 @@
+/**
+ * Static single assignment form over a single function.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "cfg.h"
+
+/* Data Structures */
+typedef enum InstKind {
+    INST_ENTRY,   // A variable's value on entry to the function
+    INST_PHI,
+    INST_ASSIGN,  // `x = e` for a tracked scalar, with a plain `e`
+    INST_OPAQUE,  // A write the IR doesn't model, so of an unknown value
+    INST_EFFECT,  // A plain statement that writes no tracked scalar
+    INST_BRANCH,  // The condition of an if or while, or a returned value
+} InstKind;
+
+typedef struct Use {
+    Node* node;  // The reference to the variable in the AST
+    int name;    // The instruction that defined the value read
+    int copy;    // A name with the same value, readable here instead, or -1
+} Use;
+
+typedef struct Inst {
+    InstKind kind;
+    Block* block;
+    int var;        // Tracked variable defined, or -1
+    Node* expr;     // Right hand side or condition, if plain
+
+    int first_use;  // Uses of tracked variables in `expr`
+    int num_uses;
+
+    int* args;      // For a phi, the name reaching along each predecessor
+    int source;     // For a copy, the name ultimately copied, or -1
+
+    int* users;     // Instructions that read this one's value
+    int num_users;
+    int cap_users;
+} Inst;
+
+typedef struct Ssa {
+    Cfg* cfg;
+
+    Block*** preds;  // Reachable predecessors, by block id
+    int* num_preds;
+    Block** idom;    // Immediate dominators, by block id
+
+    int** order;     // Instructions of each block in order, phis first
+    int* num_order;
+    int* cap_order;
+
+    Inst* insts;     // Each defines the SSA name of its own index
+    int num_insts;
+    int cap_insts;
+
+    Use* uses;
+    int num_uses;
+    int cap_uses;
+} Ssa;
+
+/* Function Prototypes */
+Ssa* build_ssa(Node* func);
+void free_ssa(Ssa* ssa);
+int pred_index(Ssa* ssa, Block* b, Block* pred);
@@ -0,0 +1,411 @@
+/**
+ * Induction variable strength reduction.
+ *
+ * A basic induction variable is a local stepped by a constant once per trip
+ * round a while loop, by a statement at the top level of its body. Each
+ * array indexed by it in the loop, `a[i]` or `a[i + c]`, gets a pointer to
+ * element i, set before the loop and stepped alongside the variable, and the
+ * accesses become loads and stores at a fixed offset from it.
+ *
+ * Locals are laid out downwards from $fp, globals upwards from their label,
+ * so a pointer moves in the opposite direction to the index for a local
+ * array.
+ *
+ * If the loop then uses the variable only to step it and to test it against
+ * an invariant bound, and it is dead once the loop is done, the test is made
+ * against a pointer to the bound's element instead and the variable's step
+ * is removed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cfg.h"
+#include "optimise.h"
+#include "shared.h"
+
+// Furthest element from the pointer reached through a load's 16 bit offset
+#define MAX_ELEMENTS 8191
+
+typedef struct Reducer {
+    Node* func;
+} Reducer;
+
+static void reduce_stmts(Reducer* r, Node* n);
+static void reduce_loop(Reducer* r, Node* loop);
+static Node* find_step(Reducer* r, Node* loop, int* step);
+static Node* find_access(Node* n, char* iv);
+static bool is_iv_index(Node* index, char* iv, int* elements);
+static void replace_accesses(Node* n, char* iv, char* array, char* pointer,
+        int scale);
+static void rewrite_test(Reducer* r, Node* loop, Node* step_stmt, char* iv,
+        char* array, char* pointer);
+static bool is_bound(Node* loop, Node* n);
+static int loop_writes(Node* loop, char* id);
+static int count_reads(Node* n, char* id);
+static bool is_dead_after(Reducer* r, Node* loop, char* id);
+static Node* loop_body(Node* loop);
+
+/**
+ * Strength reduce the array accesses of every loop in the program.
+ */
+void reduce_induction_variables(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        // An array parameter is a pointer already, with no known layout
+        if ((n->element.decl->declaration_kind == DEC_FUNC) &&
+                !has_array_param(n)) {
+            Reducer r = { .func = n };
+            reduce_stmts(&r, n->child[1]);
+        }
+    }
+}
+
+/* Private */
+
+/**
+ * Visit loops innermost first, so that an inner loop's pointers are set up
+ * before the outer loop is looked at.
+ */
+static void reduce_stmts(Reducer* r, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            reduce_stmts(r, n->child[1]);
+        } else if (n->kind == NODE_STMT) {
+            switch (n->element.stmt->statement_kind) {
+                case STMT_IF:
+                    reduce_stmts(r, n->child[1]);
+                    reduce_stmts(r, n->child[2]);
+                    break;
+                case STMT_WHILE:
+                    reduce_stmts(r, n->child[1]);
+                    reduce_loop(r, n);
+                    // Setting up pointers moves the loop along the list
+                    while ((n->kind != NODE_STMT) ||
+                            (n->element.stmt->statement_kind != STMT_WHILE)) {
+                        n = n->sibling;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+static void reduce_loop(Reducer* r, Node* loop)
+{
+    int step = 0;
+    Node* step_stmt = find_step(r, loop, &step);
+    if (step_stmt == NULL) {
+        return;
+    }
+    char* iv = step_stmt->child[0]->child[0]->token_str;
+
+    Node* access = NULL;
+    char* first = NULL;
+    char* first_pointer = NULL;
+    while (((access = find_access(loop->child[0], iv)) != NULL) ||
+            ((access = find_access(loop->child[1], iv)) != NULL)) {
+        char* array = access->token_str;
+        char* pointer = fresh_local(r->func, array, "ptr");
+        add_local(r->func, pointer);
+        if (first == NULL) {
+            first = array;
+            first_pointer = pointer;
+        }
+
+        // Locals grow downwards, so are stepped the other way
+        int scale = declares(r->func, array) ? -4 : 4;
+        Node* bump = new_assign_stmt(pointer, new_binop("+", new_var(pointer),
+                new_num(step * scale)));
+        bump->sibling = step_stmt->sibling;
+        step_stmt->sibling = bump;
+
+        replace_accesses(loop->child[0], iv, array, pointer, scale);
+        replace_accesses(loop->child[1], iv, array, pointer, scale);
+
+        insert_before(loop, new_assign_stmt(pointer,
+                new_address(array, new_var(iv))));
+        loop = loop->sibling;
+
+        remark("strength reduced '%s[%s]' in '%s'", array, iv,
+                r->func->token_str);
+    }
+
+    if (first != NULL) {
+        rewrite_test(r, loop, step_stmt, iv, first, first_pointer);
+    }
+}
+
+/**
+ * The statement stepping a basic induction variable, `i = i + c`, `i = c + i`
+ * or `i = i - c`, at the top level of the loop's body, if the variable is a
+ * local scalar assigned nowhere else in the loop.
+ */
+static Node* find_step(Reducer* r, Node* loop, int* step)
+{
+    for (Node* s = loop_body(loop); s != NULL; s = s->sibling) {
+        if ((s->kind != NODE_STMT) ||
+                (s->element.stmt->statement_kind != STMT_EXPR) ||
+                (s->child[0] == NULL) || (s->child[0]->kind != NODE_EXPR)) {
+            continue;
+        }
+
+        Node* target = s->child[0]->child[0];
+        Node* rhs = s->child[0]->child[1];
+        if ((target->child[0] != NULL) || is_deref(target) ||
+                (rhs->kind != NODE_ADDIT) ||
+                !declares(r->func, target->token_str)) {
+            continue;
+        }
+
+        Node* var = rhs->child[0];
+        Node* num = rhs->child[1];
+        if (!strcmp(rhs->token_str, "+") && (var->kind == NODE_FACTOR)) {
+            var = rhs->child[1];
+            num = rhs->child[0];
+        }
+        if ((var->kind != NODE_VAR) || (var->child[0] != NULL) ||
+                strcmp(var->token_str, target->token_str) ||
+                (num->kind != NODE_FACTOR)) {
+            continue;
+        }
+
+        if (loop_writes(loop, target->token_str) == 1) {
+            *step = atoi(num->token_str);
+            if (!strcmp(rhs->token_str, "-")) {
+                *step = -*step;
+            }
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * An access `a[iv + c]` to an array declared with a size, outside of any
+ * inlined body.
+ */
+static Node* find_access(Node* n, char* iv)
+{
+    int elements = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && (n->child[0] != NULL) &&
+                (n->element.var->variable_kind != VAR_ADDRESS) &&
+                is_iv_index(n->child[0], iv, &elements)) {
+            return n;
+        }
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind == CALL_INLINE)) {
+            continue;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            Node* access = find_access(n->child[i], iv);
+            if (access != NULL) {
+                return access;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * True if an index is the variable, or the variable plus or minus a
+ * constant, giving the constant in `elements`. The constant must be small
+ * enough that its offset in bytes fits a load's immediate.
+ */
+static bool is_iv_index(Node* index, char* iv, int* elements)
+{
+    Node* var = index;
+    *elements = 0;
+    if (index->kind == NODE_ADDIT) {
+        var = index->child[0];
+        Node* num = index->child[1];
+        if (!strcmp(index->token_str, "+") && (var->kind == NODE_FACTOR)) {
+            var = index->child[1];
+            num = index->child[0];
+        }
+        if (num->kind != NODE_FACTOR) {
+            return false;
+        }
+        *elements = atoi(num->token_str);
+        if (!strcmp(index->token_str, "-")) {
+            *elements = -*elements;
+        }
+        if ((*elements < -MAX_ELEMENTS) || (*elements > MAX_ELEMENTS)) {
+            return false;
+        }
+    }
+    return (var->kind == NODE_VAR) && (var->child[0] == NULL) &&
+            !is_deref(var) && !strcmp(var->token_str, iv);
+}
+
+static void replace_accesses(Node* n, char* iv, char* array, char* pointer,
+        int scale)
+{
+    int elements = 0;
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CALL) &&
+                (n->element.call->call_kind == CALL_INLINE)) {
+            continue;
+        }
+        if ((n->kind == NODE_VAR) && (n->child[0] != NULL) &&
+                (n->element.var->variable_kind != VAR_ADDRESS) &&
+                !strcmp(n->token_str, array) &&
+                is_iv_index(n->child[0], iv, &elements)) {
+            Node* sibling = n->sibling;
+            *n = *new_deref(pointer, elements * scale);
+            n->sibling = sibling;
+            continue;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            replace_accesses(n->child[i], iv, array, pointer, scale);
+        }
+    }
+}
+
+/**
+ * Test a pointer against the address of the bound's element instead of the
+ * variable against the bound, and drop the variable's step, if nothing else
+ * needs the variable.
+ */
+static void rewrite_test(Reducer* r, Node* loop, Node* step_stmt, char* iv,
+        char* array, char* pointer)
+{
+    Node* cond = loop->child[0];
+    if ((cond->kind != NODE_SEXPR) ||
+            (cond->element.sexpr->simple_expression_kind != SEXPR_RELOP)) {
+        return;
+    }
+
+    // Put the variable on the left
+    Node* lhs = cond->child[0];
+    Node* rhs = cond->child[1];
+    bool swapped = false;
+    if ((rhs->kind == NODE_VAR) && (rhs->child[0] == NULL) &&
+            !strcmp(rhs->token_str, iv)) {
+        lhs = cond->child[1];
+        rhs = cond->child[0];
+        swapped = true;
+    }
+    if ((lhs->kind != NODE_VAR) || (lhs->child[0] != NULL) ||
+            is_deref(lhs) || strcmp(lhs->token_str, iv) ||
+            !is_bound(loop, rhs)) {
+        return;
+    }
+
+    // The step and the test must be the only uses left
+    if ((count_reads(loop->child[0], iv) +
+                count_reads(loop->child[1], iv) != 2) ||
+            !is_dead_after(r, loop, iv)) {
+        return;
+    }
+
+    // Locals are laid out downwards, so compare the other way; likewise if
+    // the operands were the other way round
+    char* op = cond->token_str;
+    if (declares(r->func, array) != swapped) {
+        if (!strcmp(op, "<")) {
+            op = ">";
+        } else if (!strcmp(op, "<=")) {
+            op = ">=";
+        } else if (!strcmp(op, ">")) {
+            op = "<";
+        } else if (!strcmp(op, ">=")) {
+            op = "<=";
+        }
+    }
+
+    char* end = fresh_local(r->func, array, "end");
+    add_local(r->func, end);
+    insert_before(loop, new_assign_stmt(end, new_address(array, rhs)));
+    loop = loop->sibling;
+
+    cond->token_str = op;
+    cond->child[0] = new_var(pointer);
+    cond->child[1] = new_var(end);
+
+    step_stmt->child[0] = NULL;
+
+    remark("loop test on '%s' in '%s' now compares pointers", iv,
+            r->func->token_str);
+}
+
+/**
+ * A constant, or a scalar the loop does not assign. A global also must not
+ * be written by a call.
+ */
+static bool is_bound(Node* loop, Node* n)
+{
+    if (n->kind == NODE_FACTOR) {
+        return true;
+    }
+    return (n->kind == NODE_VAR) && (n->child[0] == NULL) && !is_deref(n) &&
+            (loop_writes(loop, n->token_str) == 0) &&
+            !has_calls(loop->child[0]) && !has_calls(loop->child[1]);
+}
+
+/**
+ * Assignments to a scalar in a loop's condition and body.
+ */
+static int loop_writes(Node* loop, char* id)
+{
+    return count_writes(loop->child[0], id) + count_writes(loop->child[1], id);
+}
+
+/**
+ * Reads of a scalar, anywhere under `n`.
+ */
+static int count_reads(Node* n, char* id)
+{
+    int reads = 0;
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_EXPR) {
+            reads += count_reads(n->child[0]->child[0], id);
+            reads += count_reads(n->child[1], id);
+            continue;
+        }
+        if ((n->kind == NODE_VAR) && !strcmp(n->token_str, id)) {
+            reads += 1;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            reads += count_reads(n->child[i], id);
+        }
+    }
+    return reads;
+}
+
+/**
+ * True if the variable is not live on leaving the loop.
+ */
+static bool is_dead_after(Reducer* r, Node* loop, char* id)
+{
+    Cfg* cfg = build_cfg(r->func);
+    compute_liveness(cfg);
+
+    bool dead = false;
+    int v = find_var(cfg, id);
+    for (int i = 0; i < cfg->num_blocks; ++i) {
+        Block* b = cfg->blocks[i];
+        // The exit is the second successor of the block testing the loop
+        if ((b->branch == loop) && (b->num_succ == 2) && (v >= 0)) {
+            dead = !b->succ[1]->live_in[v];
+        }
+    }
+
+    free_cfg(cfg);
+    return dead;
+}
+
+/**
+ * The top-level statements of a loop's body.
+ */
+static Node* loop_body(Node* loop)
+{
+    Node* body = loop->child[1];
+    return body->kind == NODE_CSTMT ? body->child[1] : body;
+}
@@ -26,6 +26,10 @@ typedef struct Symbol {
 
     bool local;
     int offset;
+    char* reg;         // Register holding the variable, or NULL if in memory
+    bool frameless;    // Function is a leaf compiled without a frame
+    int early_exits;   // Leading statements tested before the frame is set up
+    unsigned clobbers; // Leaf registers it or anything it calls may write
 
     struct Symbol* next;
     struct Symbol* prev;
@@ -0,0 +1,94 @@
+/**
+ * Tail call marking.
+ *
+ * A call whose value is returned directly, `return f(...);`, is marked
+ * CALL_TAIL. The generator then overwrites the current function's incoming
+ * arguments with the new ones and jumps to the callee, which returns
+ * straight to our caller, instead of building a frame on top of ours.
+ *
+ * The callee's stack arguments must fit in the space ours were passed in,
+ * so a sibling call needs no more parameters beyond those passed in
+ * registers than the current function has.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "optimise.h"
+#include "shared.h"
+
+static void mark_stmts(Node* program, Node* func, Node* n);
+static void mark_call(Node* program, Node* func, Node* call);
+
+void mark_tail_calls(Node* program)
+{
+    for (Node* f = program; f != NULL; f = f->sibling) {
+        // main is not entered through a call, so has nothing to return to
+        if ((f->element.decl->declaration_kind == DEC_FUNC) &&
+                strcmp(f->token_str, "main")) {
+            mark_stmts(program, f, f->child[1]);
+        }
+    }
+}
+
+/* Private */
+
+/**
+ * Only statement lists are walked: returns in an inlined body leave the
+ * inlined body, not the function.
+ */
+static void mark_stmts(Node* program, Node* func, Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            mark_stmts(program, func, n->child[1]);
+        } else if (n->kind == NODE_STMT) {
+            switch (n->element.stmt->statement_kind) {
+                case STMT_IF:
+                    mark_stmts(program, func, n->child[1]);
+                    mark_stmts(program, func, n->child[2]);
+                    break;
+                case STMT_WHILE:
+                    mark_stmts(program, func, n->child[1]);
+                    break;
+                case STMT_RETURN:
+                    if ((n->child[0] != NULL) &&
+                            (n->child[0]->kind == NODE_CALL)) {
+                        mark_call(program, func, n->child[0]);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+static void mark_call(Node* program, Node* func, Node* call)
+{
+    if (call->element.call->call_kind == CALL_INLINE) {
+        return;
+    }
+
+    Node* callee = find_function(program, call->token_str);
+    if (callee == NULL) {
+        // input and output have no frame to replace
+        return;
+    }
+
+    if (has_array_param(callee) || has_array_param(func)) {
+        remark("not a tail call to '%s' in '%s': array parameter",
+                callee->token_str, func->token_str);
+        return;
+    }
+    if (num_stack_params(callee) > num_stack_params(func)) {
+        remark("not a tail call to '%s' in '%s': needs more argument space",
+                callee->token_str, func->token_str);
+        return;
+    }
+
+    remark("tail call to '%s' in '%s'", callee->token_str, func->token_str);
+    call->element.call->call_kind = CALL_TAIL;
+}
@@ -0,0 +1,478 @@
+/**
+ * Loop unrolling.
+ *
+ * A counted loop tests a local scalar against a constant, and steps it by a
+ * constant at the end of its body: `while (i < 64) { ...; i = i + 1; }`. Any
+ * other locals stepped alongside it there are induction variables too.
+ *
+ * The loop's body is copied `--unroll` times into a new loop in front of it,
+ * with each copy reading an induction variable as though the steps before it
+ * had been made, `i + 1`, `i + 2`, and so on, and a single step at the end.
+ * Its bound is lowered to leave room for the extra iterations, and the
+ * original loop stays behind to run whatever is left over.
+ *
+ * When the variable is set to a constant before the loop, the trip count is
+ * known. There is nothing left over if it is a multiple of the factor, and a
+ * loop whose every iteration fits in `--unroll-limit` is unrolled entirely.
+ *
+ * With a profile, a loop whose body never ran is left alone, and a hot loop
+ * may grow to several times the limit.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "optimise.h"
+#include "profile.h"
+#include "shared.h"
+
+// Multiplies the size limit for hot loops
+#define HOT_LIMIT_FACTOR 4
+
+typedef struct Counted {
+    Node* func;
+    Node* loop;
+    Node* body;         // The first statement of the loop's body
+    Node* steps;        // The first of the steps that end it
+    char* iv;           // The variable tested
+    int step;
+    int bound;
+
+    bool known;         // The variable's value on entry, and so the trip
+    int init;           // count, are known
+    int trips;
+} Counted;
+
+static void unroll_stmts(Node* func, Node* n);
+static bool unroll_loop(Node* func, Node* list, Node* loop);
+static bool find_counted(Node* func, Node* loop, Counted* c);
+static bool is_step(Node* func, Node* n, char** id, int* step);
+static bool has_decls(Node* n);
+static bool known_on_entry(Node* list, Node* loop, char* id, int* value);
+static int trip_count(char* op, int init, int bound, int step);
+static Node* unrolled_body(Counted* c, int copies, bool fold);
+static void offset_reads(Node* n, char* id, Node* value);
+static void offset_derefs(Node* n, char* id, int offset);
+static Node* new_offset(char* id, int offset);
+
+/**
+ * Unroll every counted loop in the program, innermost first.
+ */
+void unroll_loops(Node* n)
+{
+    // Copies of a body don't keep its profile site, so would go uncounted
+    if ((options.unroll < 2) || options.profile_generate) {
+        return;
+    }
+
+    for (; n != NULL; n = n->sibling) {
+        if (n->element.decl->declaration_kind == DEC_FUNC) {
+            unroll_stmts(n, n->child[1]);
+        }
+    }
+}
+
+/* Private */
+
+static void unroll_stmts(Node* func, Node* n)
+{
+    Node* list = n;
+    for (; n != NULL; n = n->sibling) {
+        if (n->kind == NODE_CSTMT) {
+            unroll_stmts(func, n->child[1]);
+        } else if (n->kind == NODE_STMT) {
+            switch (n->element.stmt->statement_kind) {
+                case STMT_IF:
+                    unroll_stmts(func, n->child[1]);
+                    unroll_stmts(func, n->child[2]);
+                    break;
+                case STMT_WHILE:
+                    unroll_stmts(func, n->child[1]);
+                    if (unroll_loop(func, list, n)) {
+                        // Skip the original loop, now behind the copy
+                        n = n->sibling;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/**
+ * Unroll a loop if it is counted, returning true if an unrolled copy was put
+ * in front of it.
+ */
+static bool unroll_loop(Node* func, Node* list, Node* loop)
+{
+    Counted c = { .func = func, .loop = loop };
+    if (!find_counted(func, loop, &c)) {
+        return false;
+    }
+
+    long count = site_count(loop->child[1]);
+    if (is_cold(count)) {
+        remark("not unrolling loop on '%s' in '%s': never run in the profile",
+                c.iv, func->token_str);
+        return false;
+    }
+    long long max_size = (long long) options.unroll_limit *
+            (is_hot(count) ? HOT_LIMIT_FACTOR : 1);
+
+    if (known_on_entry(list, loop, c.iv, &c.init)) {
+        c.trips = trip_count(loop->child[0]->token_str, c.init, c.bound,
+                c.step);
+        c.known = c.trips >= 0;
+    }
+    if (c.known && (c.trips == 0)) {
+        return false;
+    }
+
+    int size = 0;
+    for (Node* s = c.body; s != c.steps; s = s->sibling) {
+        Node* sibling = s->sibling;
+        s->sibling = NULL;
+        size += count_nodes(s);
+        s->sibling = sibling;
+    }
+
+    if (c.known && ((long long) c.trips * size <= max_size)) {
+        Node* sibling = loop->sibling;
+        Node* block = new_node(NODE_CSTMT);
+        block->element.cstmt->compound_statement_kind = CSTMT_MAIN;
+        block->child[0] = NULL;
+        block->child[1] = unrolled_body(&c, c.trips, true);
+        *loop = *block;
+        loop->sibling = sibling;
+
+        remark("fully unrolled loop on '%s' in '%s' (%d iterations)", c.iv,
+                func->token_str, c.trips);
+        return false;
+    }
+
+    int factor = options.unroll;
+    if ((long long) factor * size > max_size) {
+        remark("not unrolling loop on '%s' in '%s': body of %d too large "
+                "to copy %d times", c.iv, func->token_str, size, factor);
+        return false;
+    }
+    if (c.known && (c.trips < factor)) {
+        return false;
+    }
+
+    // The copies run while the last of them would still pass the test
+    long long limit = (long long) c.bound - (long long) (factor - 1) * c.step;
+    if ((limit < INT_MIN) || (limit > INT_MAX)) {
+        return false;
+    }
+
+    Node* cond = loop->child[0];
+    Node* sibling = cond->sibling;
+    cond->sibling = NULL;
+    Node* main_cond = copy_tree(cond);
+    cond->sibling = sibling;
+    main_cond->child[1] = new_num((int) limit);
+
+    Node* main_body = new_node(NODE_CSTMT);
+    main_body->element.cstmt->compound_statement_kind = CSTMT_MAIN;
+    main_body->child[0] = NULL;
+    main_body->child[1] = unrolled_body(&c, factor, false);
+
+    remark("unrolled loop on '%s' in '%s' by %d", c.iv, func->token_str,
+            factor);
+
+    if (c.known && (c.trips % factor == 0)) {
+        // Nothing is left over for the original loop to do
+        loop->child[0] = main_cond;
+        loop->child[1] = main_body;
+        return false;
+    }
+
+    Node* main_loop = new_node(NODE_STMT);
+    main_loop->element.stmt->statement_kind = STMT_WHILE;
+    main_loop->child[0] = main_cond;
+    main_loop->child[1] = main_body;
+    // The copies may leave nothing for the original loop to run
+    loop->element.stmt->enters = false;
+    insert_before(loop, main_loop);
+    return true;
+}
+
+/**
+ * Find the parts of a counted loop, returning false if it is not one.
+ */
+static bool find_counted(Node* func, Node* loop, Counted* c)
+{
+    Node* body = loop->child[1];
+    if (has_decls(body)) {
+        // Each copy would declare them again
+        return false;
+    }
+    c->body = body->kind == NODE_CSTMT ? body->child[1] : body;
+
+    // The steps are those after the last statement that is not one, each of
+    // a variable written nowhere else in the loop
+    for (Node* s = c->body; s != NULL; s = s->sibling) {
+        char* id = NULL;
+        int step = 0;
+        if (is_empty_stmt(s)) {
+            continue;
+        }
+        if (is_step(func, s, &id, &step) &&
+                (count_writes(loop->child[0], id) +
+                 count_writes(loop->child[1], id) == 1)) {
+            if (c->steps == NULL) {
+                c->steps = s;
+            }
+        } else {
+            c->steps = NULL;
+        }
+    }
+    if (c->steps == NULL) {
+        return false;
+    }
+
+    Node* cond = loop->child[0];
+    if ((cond->kind != NODE_SEXPR) ||
+            (cond->element.sexpr->simple_expression_kind != SEXPR_RELOP) ||
+            (cond->child[0]->kind != NODE_VAR) ||
+            (cond->child[0]->child[0] != NULL) || is_deref(cond->child[0]) ||
+            (cond->child[1]->kind != NODE_FACTOR)) {
+        return false;
+    }
+    c->iv = cond->child[0]->token_str;
+    c->bound = atoi(cond->child[1]->token_str);
+
+    for (Node* s = c->steps; s != NULL; s = s->sibling) {
+        char* id = NULL;
+        int step = 0;
+        if (is_step(func, s, &id, &step) && !strcmp(id, c->iv)) {
+            c->step = step;
+        }
+    }
+
+    char* op = cond->token_str;
+    if (c->step > 0) {
+        return !strcmp(op, "<") || !strcmp(op, "<=");
+    }
+    if (c->step < 0) {
+        return !strcmp(op, ">") || !strcmp(op, ">=");
+    }
+    return false;
+}
+
+/**
+ * True if the statement steps a local scalar by a constant, `i = i + c`,
+ * `i = c + i` or `i = i - c`, giving the scalar and the step.
+ */
+static bool is_step(Node* func, Node* n, char** id, int* step)
+{
+    if ((n->kind != NODE_STMT) ||
+            (n->element.stmt->statement_kind != STMT_EXPR) ||
+            (n->child[0] == NULL) || (n->child[0]->kind != NODE_EXPR)) {
+        return false;
+    }
+
+    Node* target = n->child[0]->child[0];
+    Node* rhs = n->child[0]->child[1];
+    if ((target->child[0] != NULL) || is_deref(target) ||
+            (rhs->kind != NODE_ADDIT) ||
+            !declares(func, target->token_str)) {
+        return false;
+    }
+
+    Node* var = rhs->child[0];
+    Node* num = rhs->child[1];
+    if (!strcmp(rhs->token_str, "+") && (var->kind == NODE_FACTOR)) {
+        var = rhs->child[1];
+        num = rhs->child[0];
+    }
+    if ((var->kind != NODE_VAR) || (var->child[0] != NULL) ||
+            is_deref(var) || strcmp(var->token_str, target->token_str) ||
+            (num->kind != NODE_FACTOR)) {
+        return false;
+    }
+
+    *id = target->token_str;
+    *step = atoi(num->token_str);
+    if (!strcmp(rhs->token_str, "-")) {
+        *step = -*step;
+    }
+    return true;
+}
+
+static bool has_decls(Node* n)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_CSTMT) && (n->child[0] != NULL)) {
+            return true;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            if (has_decls(n->child[i])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * True if the local `id` holds a known constant when `loop` is reached,
+ * having been assigned one earlier in the same list and not written since.
+ */
+static bool known_on_entry(Node* list, Node* loop, char* id, int* value)
+{
+    bool known = false;
+    for (Node* s = list; s != loop; s = s->sibling) {
+        Node* assign = s->child[0];
+        if ((s->kind == NODE_STMT) &&
+                (s->element.stmt->statement_kind == STMT_EXPR) &&
+                (assign != NULL) && (assign->kind == NODE_EXPR) &&
+                (assign->child[0]->child[0] == NULL) &&
+                !is_deref(assign->child[0]) &&
+                !strcmp(assign->child[0]->token_str, id) &&
+                (assign->child[1]->kind == NODE_FACTOR)) {
+            known = true;
+            *value = atoi(assign->child[1]->token_str);
+        } else if (count_writes(s, id) > 0) {
+            known = false;
+        }
+    }
+    return known;
+}
+
+/**
+ * Iterations of a loop testing `i op bound` from `i = init` in steps of
+ * `step`, or -1 if there are too many to count.
+ */
+static int trip_count(char* op, int init, int bound, int step)
+{
+    long long distance = (long long) bound - init;
+    long long stride = step;
+    if (step < 0) {
+        distance = -distance;
+        stride = -stride;
+    }
+
+    long long trips = 0;
+    if (!strcmp(op, "<") || !strcmp(op, ">")) {
+        trips = distance > 0 ? (distance + stride - 1) / stride : 0;
+    } else {
+        trips = distance >= 0 ? distance / stride + 1 : 0;
+    }
+    return trips > INT_MAX ? -1 : (int) trips;
+}
+
+/**
+ * Copies of the loop's body, each reading the induction variables as they
+ * would be on the iteration it stands for, followed by their steps made all
+ * at once. With `fold`, the copies read the tested variable as a constant,
+ * its value on entry being known.
+ */
+static Node* unrolled_body(Counted* c, int copies, bool fold)
+{
+    Node* head = NULL;
+    Node** tail = &head;
+
+    for (int k = 0; k < copies; ++k) {
+        for (Node* s = c->body; s != c->steps; s = s->sibling) {
+            Node* sibling = s->sibling;
+            s->sibling = NULL;
+            Node* copy = copy_tree(s);
+            s->sibling = sibling;
+
+            for (Node* t = c->steps; t != NULL; t = t->sibling) {
+                char* id = NULL;
+                int step = 0;
+                if (!is_step(c->func, t, &id, &step)) {
+                    continue;
+                }
+                if (fold && !strcmp(id, c->iv)) {
+                    // Within range, as the bound it stays short of is
+                    offset_reads(copy, id, new_num(c->init + k * step));
+                } else if (k > 0) {
+                    offset_reads(copy, id, new_offset(id, k * step));
+                }
+                // The variable itself isn't stepped until the end
+                offset_derefs(copy, id, k * step);
+            }
+
+            *tail = copy;
+            tail = &copy->sibling;
+        }
+    }
+
+    for (Node* t = c->steps; t != NULL; t = t->sibling) {
+        char* id = NULL;
+        int step = 0;
+        if (is_step(c->func, t, &id, &step)) {
+            Node* stmt = NULL;
+            if (fold && !strcmp(id, c->iv)) {
+                stmt = new_assign_stmt(id, new_num(c->init + copies * step));
+            } else {
+                stmt = new_assign_stmt(id, new_offset(id, copies * step));
+            }
+            *tail = stmt;
+            tail = &stmt->sibling;
+        }
+    }
+    return head;
+}
+
+/**
+ * Replace every read of the scalar with a copy of `value`.
+ */
+static void offset_reads(Node* n, char* id, Node* value)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && (n->child[0] == NULL) &&
+                (n->element.var->variable_kind == VAR_SINGLE) &&
+                !strcmp(n->token_str, id)) {
+            Node* sibling = n->sibling;
+            *n = *copy_tree(value);
+            n->sibling = sibling;
+            continue;
+        }
+        if (n->kind == NODE_EXPR) {
+            // The target is written, not read, but its index is read
+            offset_reads(n->child[0]->child[0], id, value);
+            offset_reads(n->child[1], id, value);
+            continue;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            offset_reads(n->child[i], id, value);
+        }
+    }
+}
+
+/**
+ * Move every access through the scalar, left by strength reduction, on by
+ * `offset` bytes.
+ */
+static void offset_derefs(Node* n, char* id, int offset)
+{
+    for (; n != NULL; n = n->sibling) {
+        if ((n->kind == NODE_VAR) && is_deref(n) &&
+                !strcmp(n->token_str, id)) {
+            n->element.var->offset += offset;
+        }
+        for (int i = 0; i < MAX_CHILDREN; ++i) {
+            offset_derefs(n->child[i], id, offset);
+        }
+    }
+}
+
+/**
+ * `id + offset`, or `id - -offset` for a negative offset.
+ */
+static Node* new_offset(char* id, int offset)
+{
+    if (offset < 0) {
+        return new_binop("-", new_var(id), new_num(-offset));
+    }
+    return new_binop("+", new_var(id), new_num(offset));
+}
@@ -0,0 +1,30 @@
+int sum(int n)
+{
+    if (n == 0) {
+        return 0;
+    }
+    return n + sum(n - 1);
+}
+
+int power(int b, int e)
+{
+    if (e == 0) {
+        return 1;
+    }
+    return power(b, e - 1) * b;
+}
+
+int tally(int n)
+{
+    if (n == 0) {
+        return;
+    }
+    return n + tally(n - 1);
+}
+
+void main(void)
+{
+    output(sum(50000));
+    output(power(3, 5));
+    tally(3);
+}
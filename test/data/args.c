@@ -0,0 +1,42 @@
+int sum(int a, int b, int c, int d, int e, int f)
+{
+    return a + 10 * (b + 10 * (c + 10 * (d + 10 * (e + 10 * f))));
+}
+
+int weigh(int a, int b, int c, int d, int e, int f)
+{
+    int t[2];
+    t[0] = a - b;
+    t[1] = e * f;
+    return t[0] + c * d + t[1];
+}
+
+int walk(int n, int a, int b, int c, int d, int e)
+{
+    if (n == 0) {
+        return sum(a, b, c, d, e, 0);
+    }
+    return walk(n - 1, e, a, b, c, d);
+}
+
+int hop(int n, int a, int b, int c, int d, int e)
+{
+    if (n == 0) {
+        return weigh(a, b, c, d, e, n);
+    }
+    return hop(n - 1, b, c, d, e, a);
+}
+
+int pair(int x, int y)
+{
+    return x * 100 + y;
+}
+
+void main(void)
+{
+    output(sum(1, 2, 3, 4, 5, 6));
+    output(weigh(9, 2, 3, 4, 5, 6));
+    output(pair(pair(1, 2), weigh(1, 1, 1, 1, 1, pair(0, 3))));
+    output(walk(3, 1, 2, 3, 4, 5));
+    output(hop(7, 1, 2, 3, 4, 5));
+}
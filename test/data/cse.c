@@ -0,0 +1,51 @@
+int a[8];
+int b[8];
+int g;
+
+void bump(void)
+{
+    g = g + 1;
+    b[3] = b[3] + 1;
+}
+
+int square(int x, int y)
+{
+    return (x + y) * (x + y) - (x - y) * (x - y);
+}
+
+void main(void)
+{
+    int i;
+    int j;
+    int k;
+
+    i = 0;
+    while (i < 8) {
+        a[i] = i;
+        b[i] = 10 - i;
+        i = i + 1;
+    }
+
+    i = input();
+    j = input();
+    a[i] = a[i] + b[j] * b[j];
+    output(a[i]);
+
+    k = g * 3 + b[i + j];
+    bump();
+    output(g * 3 + b[i + j] - k);
+
+    if (b[j] > 5) {
+        output(b[j] * b[j] + b[i + j]);
+    } else {
+        a[j] = 0;
+        output(b[j] * b[j]);
+    }
+    output(b[j] * b[j]);
+
+    k = a[i + 1] * a[i + 1];
+    a[2] = 7;
+    output(a[i + 1] * a[i + 1] - k);
+
+    output(square(i, j));
+}
@@ -0,0 +1,42 @@
+int calls;
+
+int bump(int n)
+{
+    calls = calls + 1;
+    output(n);
+    return n * 2;
+}
+
+int early(int n)
+{
+    return n + 1;
+    output(222);
+    n = 5;
+}
+
+int first(int n)
+{
+    while (1) {
+        n = n + 6;
+        return n;
+    }
+    output(111);
+    return 0;
+}
+
+void main(void)
+{
+    int x;
+    int y;
+
+    x = bump(7);
+    x = 4;
+    if (0) {
+        output(333);
+        x = 6;
+    }
+    y = early(x);
+    output(y);
+    output(first(y));
+    output(calls);
+}
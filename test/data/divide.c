@@ -0,0 +1,10 @@
+void main(void)
+{
+    int a;
+    int b;
+    a = input();
+    b = input();
+    output(a / b);
+    output(b / a);
+    return;
+}
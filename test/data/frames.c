@@ -0,0 +1,60 @@
+int g[10];
+
+int six(int a, int b, int c, int d, int e, int f)
+{
+    return ((a - b) + (c * d)) - (e * f);
+}
+
+int seven(int a, int b, int c, int d, int e, int f, int h)
+{
+    g[h] = g[h] + 1;
+    if (h > 0) {
+        return seven(b, c, d, e, f, a, h - 1);
+    }
+    return a * 1000000 + b * 100000 + c * 10000 + d * 1000 + e * 100 + f * 10;
+}
+
+int five(int a, int b, int c, int d, int e)
+{
+    if (e > 3) {
+        return six(a, b, c, d, e, e - 1);
+    }
+    return five(a + 1, b, c, d, e + 1);
+}
+
+int fewer(int a, int b, int c, int d, int e)
+{
+    return seven(a, b, c, d, e, a, 2);
+}
+
+int relay(int a, int b, int c, int d, int e, int f, int h)
+{
+    if (h > 0) {
+        return seven(h, a, b, c, d, e + f, 1);
+    }
+    return relay(b, c, d, e, f, a, h + 1);
+}
+
+int deep(int x)
+{
+    int arr[4];
+    arr[x] = (six(x, six(1, 2, 3, 4, 5, 6), x + 1, x * (x + (x * (x - 1))), six(x, x, x, x, x, x), 2) - (x * (x + 1)));
+    return arr[x] + arr[x] * (arr[x] - x);
+}
+
+void main(void)
+{
+    int i;
+    output(six(1, 2, 3, 4, 5, 6));
+    output(seven(1, 2, 3, 4, 5, 6, 5));
+    output(five(1, 2, 3, 4, 0));
+    output(fewer(9, 8, 7, 6, 5));
+    output(deep(2));
+    output(six(seven(1, 1, 1, 1, 1, 1, 0), 2, six(1, 2, 3, 4, 5, 6), 4, five(0, 0, 0, 0, 0), 6));
+    output(relay(1, 2, 3, 4, 5, 6, 0));
+    i = 0;
+    while (i < 10) {
+        output(g[i]);
+        i = i + 1;
+    }
+}
@@ -0,0 +1,28 @@
+int count;
+int pair[2];
+int table[20];
+int total;
+
+void tally(int n)
+{
+    count = count + 1;
+    total = total + n;
+    pair[n - (n / 2) * 2] = pair[n - (n / 2) * 2] + n;
+}
+
+void main(void)
+{
+    int i;
+
+    i = 0;
+    while (i < 20) {
+        table[i] = i * i;
+        tally(table[i]);
+        i = i + 1;
+    }
+    output(count);
+    output(total);
+    output(pair[0]);
+    output(pair[1]);
+    output(table[19]);
+}
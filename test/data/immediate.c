@@ -0,0 +1,46 @@
+int count(int x)
+{
+    int n;
+    n = 0;
+    if (x < 10) {
+        n = n + 1;
+    }
+    if (x <= 32766) {
+        n = n + 2;
+    }
+    if (10 < x) {
+        n = n + 4;
+    }
+    if (x == 0 - 32768) {
+        n = n + 8;
+    }
+    if (x != 32767) {
+        n = n + 16;
+    }
+    return n;
+}
+
+void main(void)
+{
+    int a[6];
+    int i;
+    int x;
+    a[0] = 0 - 32768;
+    a[1] = 32767;
+    a[2] = 32766;
+    a[3] = 10;
+    a[4] = 11;
+    a[5] = 0 - 32769;
+    i = 0;
+    while (i < 6) {
+        x = a[i];
+        output(count(x));
+        output(x >= 0 - 32768);
+        output(x > 32766);
+        output(0 - 1 <= x);
+        output(x == 32767);
+        output(2 + x != 32767);
+        output(x - 32768);
+        i = i + 1;
+    }
+}
@@ -0,0 +1,38 @@
+int calls;
+
+int square(int x)
+{
+    return x * x;
+}
+
+int clamp(int x, int lo, int hi)
+{
+    if (x < lo) {
+        return lo;
+    }
+    if (x > hi) {
+        return hi;
+    }
+    return x;
+}
+
+int count(void)
+{
+    calls = calls + 1;
+    return calls;
+}
+
+void main(void)
+{
+    int i;
+    int total;
+    i = 0;
+    total = 0;
+    while (i < 6) {
+        total = total + clamp(square(i), 2, 20);
+        i = i + 1;
+    }
+    output(total);
+    output(count());
+    output(count());
+}
@@ -0,0 +1,70 @@
+int total;
+
+int sq(int x)
+{
+    return x * x;
+}
+
+int mix(int a, int b)
+{
+    int s;
+    int t;
+    s = sq(a);
+    t = sq(b);
+    return (s + t) - (a * b);
+}
+
+int chain(int n, int k)
+{
+    int i;
+    int acc;
+    i = 0;
+    acc = 0;
+    while (i < n) {
+        acc = acc + mix(i, k);
+        i = i + 1;
+    }
+    return acc;
+}
+
+int wide(int a, int b, int c, int d, int e, int f)
+{
+    int r;
+    r = chain(e, f) + (e * f);
+    return ((r + a) + (b * c)) - (d + (e - f));
+}
+
+int down(int n)
+{
+    int keep;
+    keep = n * 2;
+    if (n == 0) {
+        return 0;
+    }
+    keep = keep + down(n - 1);
+    total = total + keep;
+    return keep + n;
+}
+
+void main(void)
+{
+    int i;
+    int j;
+    int sum;
+    sum = 0;
+    i = 0;
+    while (i < 5) {
+        j = 0;
+        while (j < 3) {
+            sum = sum + mix(i, j);
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    output(sum);
+    output(chain(6, 2));
+    output(wide(1, 2, 3, 4, 5, 6));
+    output(down(5));
+    output(total);
+    output(i + (j * sum));
+}
@@ -0,0 +1,59 @@
+int errors;
+
+int check(int x)
+{
+    if (x < 0) {
+        errors = errors + 1;
+        return 0 - 1;
+    }
+    if (x > 100) {
+        errors = errors + 1;
+        return 0 - 2;
+    }
+    return x;
+}
+
+int classify(int x)
+{
+    if (x == 0) {
+        return 0;
+    } else {
+        if (x < 50) {
+            x = x + 1000;
+        } else {
+            x = x + 2000;
+        }
+    }
+    return x;
+}
+
+int sum(int n)
+{
+    int i;
+    int s;
+    i = 0;
+    s = 0;
+    while (i < n) {
+        if (i == 7) {
+            if (errors > 0) {
+                s = s + 100;
+            } else {
+                s = s - 100;
+            }
+        } else {
+            s = s + check(i * 20 - 40);
+        }
+        i = i + 1;
+    }
+    return s;
+}
+
+void main(void)
+{
+    errors = 0;
+    output(sum(12));
+    output(errors);
+    output(classify(0));
+    output(classify(errors));
+    output(classify(errors * 20));
+}
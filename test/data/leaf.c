@@ -0,0 +1,48 @@
+int g;
+
+int mix(int a, int b, int c)
+{
+    int t;
+    t = a * 10 + b;
+    if (c > 0) {
+        int u;
+        u = t + c;
+        t = u * 2;
+    }
+    g = g + t;
+    return t;
+}
+
+void show(int x)
+{
+    output(x);
+}
+
+int twice(int n)
+{
+    int s[2];
+    s[0] = n;
+    s[1] = n;
+    return s[0] + s[1];
+}
+
+int pick(int n)
+{
+    if (n > 5) {
+        return mix(n, 1, 0);
+    }
+    return twice(n);
+}
+
+void main(void)
+{
+    int i;
+    i = 0;
+    while (i < 3) {
+        show(mix(i, 2, i));
+        i = i + 1;
+    }
+    show(pick(7));
+    show(pick(2));
+    show(g);
+}
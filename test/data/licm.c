@@ -0,0 +1,67 @@
+int n;
+int m[36];
+
+int zero(void)
+{
+    return 0;
+}
+
+int trace(int k)
+{
+    int i;
+    int j;
+    int s;
+    s = 0;
+    i = 0;
+    while (i < n * n / k) {
+        j = 0;
+        while (j < n) {
+            s = s + m[i * n + j] * (n + 1);
+            j = j + 1;
+        }
+        i = i + n;
+    }
+    return s;
+}
+
+int calls(void)
+{
+    int i;
+    int s;
+    i = 0;
+    s = 0;
+    while (i < 3) {
+        s = s + n * 2;
+        n = n + zero();
+        i = i + 1;
+    }
+    return s;
+}
+
+int divides(int d, int c)
+{
+    int i;
+    int s;
+    i = 0;
+    s = 0;
+    while (i < c) {
+        s = s + 12 / d;
+        i = i + 1;
+    }
+    return s;
+}
+
+void main(void)
+{
+    int i;
+    n = 6;
+    i = 0;
+    while (i < n * n) {
+        m[i] = i;
+        i = i + 1;
+    }
+    output(trace(1));
+    output(calls());
+    output(divides(0, 0));
+    output(divides(4, 5));
+}
@@ -0,0 +1,19 @@
+int scale(int x)
+{
+    return x * 10 + 3 * x * 7;
+}
+
+void main(void)
+{
+    int i;
+    i = 0 - 20;
+    while (i < 21) {
+        output(i / 4);
+        output(i / 7);
+        output(i / (0 - 3));
+        output(scale(i));
+        output(i * 96);
+        output(i * (0 - 15));
+        i = i + 9;
+    }
+}
@@ -0,0 +1,23 @@
+int weight(int x)
+{
+    if (x < 0) {
+        return 0 - x;
+    }
+    return x * 3 + 1;
+}
+
+void main(void)
+{
+    int i;
+    int s;
+    i = 0;
+    s = 0;
+    while (i < 40) {
+        s = s + weight(i);
+        i = i + 1;
+    }
+    if (s < 0) {
+        output(0);
+    }
+    output(s);
+}
@@ -0,0 +1,72 @@
+int g;
+
+int fact(int n)
+{
+    if (n <= 1) {
+        return 1;
+    }
+    return n * fact(n - 1);
+}
+
+int fib(int n)
+{
+    int a;
+    int b;
+    int t;
+    int i;
+
+    a = 0;
+    b = 1;
+    i = 0;
+    while (i < n) {
+        t = a + b;
+        a = b;
+        b = t;
+        i = i + 1;
+    }
+    return a;
+}
+
+int squares(int n)
+{
+    int sq[10];
+    int i;
+    int s;
+
+    i = 0;
+    while (i < 10) {
+        sq[i] = i * i;
+        i = i + 1;
+    }
+    s = 0;
+    i = 0;
+    while (i < n) {
+        s = s + sq[i];
+        i = i + 1;
+    }
+    return s;
+}
+
+int offset(int n)
+{
+    return g + n;
+}
+
+int depth(int n)
+{
+    if (n == 0) {
+        return 0;
+    }
+    return 1 + depth(n - 1);
+}
+
+void main(void)
+{
+    g = 7;
+    output(fact(5));
+    output(fib(20) - fact(fact(3)));
+    output(squares(5));
+    output(offset(3));
+    output(depth(1000));
+    output(fact(13));
+}
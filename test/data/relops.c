@@ -0,0 +1,32 @@
+int compare(int a, int b)
+{
+    int r;
+    r = 0;
+    if (a < b) {
+        r = r + 1;
+    }
+    if (a <= b) {
+        r = r + 2;
+    }
+    if (a > b) {
+        r = r + 4;
+    }
+    if (a >= b) {
+        r = r + 8;
+    }
+    if (a != b) {
+        r = r + 16;
+    }
+    return r;
+}
+
+void main(void)
+{
+    int i;
+    i = 0;
+    while (i <= 2) {
+        output(compare(i, 1));
+        i = i + 1;
+    }
+    output(i >= 3);
+}
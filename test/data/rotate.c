@@ -0,0 +1,42 @@
+int total;
+
+int count(int n)
+{
+    int i;
+    int s;
+    i = 0;
+    s = 0;
+    while (i < n) {
+        s = s + i;
+        i = i + 1;
+    }
+    return s;
+}
+
+void main(void)
+{
+    int i;
+    int j;
+
+    output(count(0));
+    output(count(10));
+
+    total = 0;
+    i = 3;
+    while (i > 0) {
+        j = 0;
+        while (j < i) {
+            total = total + 1;
+            j = j + 1;
+        }
+        i = i - 1;
+    }
+    output(total);
+
+    i = 5;
+    while (i < 5) {
+        output(i);
+        i = i + 1;
+    }
+    output(i);
+}
@@ -0,0 +1,61 @@
+int g;
+
+int sum(int n)
+{
+    int debug;
+    int limit;
+    int total;
+    int copy;
+
+    debug = 0;
+    limit = 10;
+    total = 0;
+    if (debug) {
+        limit = 100;
+        total = input();
+    }
+    copy = n;
+    while (copy < limit) {
+        total = total + copy;
+        copy = copy + 1;
+    }
+    return total;
+}
+
+void main(void)
+{
+    int i;
+    int x;
+    int y;
+    int z;
+    int flag;
+
+    x = 3;
+    z = 0;
+    i = 0;
+    while (i < 5) {
+        if (x == 3) {
+            z = z + 2;
+        } else {
+            x = 4;
+        }
+        i = i + 1;
+    }
+    output(x);
+    output(z);
+
+    flag = x - 3;
+    while (flag) {
+        output(1 / flag);
+        flag = 0;
+    }
+
+    g = 5;
+    y = g;
+    z = y;
+    output(z + y);
+    output(x - 10 * x);
+    y = 65536;
+    output(y * y + 1);
+    output(sum(7));
+}
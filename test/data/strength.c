@@ -0,0 +1,41 @@
+int g[10];
+
+int fill(int n)
+{
+    int i;
+    int s;
+    int a[10];
+    i = 0;
+    while (i < n) {
+        a[i] = i * i;
+        g[i] = a[i] + 1;
+        i = i + 1;
+    }
+    i = n - 1;
+    s = 0;
+    while (i >= 0) {
+        s = s + a[i] - g[i];
+        i = i - 1;
+    }
+    return s;
+}
+
+int sum(int from, int to)
+{
+    int i;
+    int s;
+    s = 0;
+    i = from;
+    while (to > i) {
+        s = s + g[i];
+        i = i + 2;
+    }
+    return s * 100 + i;
+}
+
+void main(void)
+{
+    output(fill(10));
+    output(sum(1, 9));
+    output(sum(0, 10));
+}
@@ -0,0 +1,51 @@
+int g;
+
+int down(int n)
+{
+    if (n == 0) {
+        return 7;
+    }
+    return down(n - 1);
+}
+
+int count(int n, int acc)
+{
+    int t[3];
+    if (n == 0) {
+        return acc;
+    }
+    t[1] = acc + 2;
+    return count(n - 1, t[1]);
+}
+
+int pick(int a, int b, int c)
+{
+    g = g + 1;
+    if (a > 100) {
+        return down(b);
+    }
+    return count(a, b + c);
+}
+
+int first(int a, int b)
+{
+    return a;
+}
+
+int swap(int a, int b, int n)
+{
+    if (n == 0) {
+        return 10 * a + b;
+    }
+    return swap(b, a, n - 1);
+}
+
+void main(void)
+{
+    output(count(100000, 0));
+    output(pick(5, 1, 2));
+    output(pick(1000, 3, 0));
+    output(swap(1, 2, 5));
+    output(first(3, 4));
+    output(g);
+}
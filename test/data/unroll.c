@@ -0,0 +1,80 @@
+int g[64];
+
+int sum(int n)
+{
+    int i;
+    int s;
+    i = 0;
+    s = 0;
+    while (i < n) {
+        s = s + i;
+        i = i + 1;
+    }
+    return s;
+}
+
+int tail(int k)
+{
+    int i;
+    int s;
+    i = k;
+    s = 0;
+    while (i < 30) {
+        s = s + i * i;
+        i = i + 3;
+    }
+    return s;
+}
+
+int first(int x)
+{
+    int i;
+    i = 0;
+    while (i < 64) {
+        if (g[i] == x) {
+            return i;
+        }
+        i = i + 1;
+    }
+    return 0 - 1;
+}
+
+void main(void)
+{
+    int a[10];
+    int i;
+    int j;
+    int s;
+
+    i = 0;
+    while (i < 64) {
+        g[i] = i * 3;
+        i = i + 1;
+    }
+    output(g[63]);
+
+    i = 9;
+    j = 100;
+    while (i >= 0) {
+        a[i] = j;
+        j = j - 7;
+        i = i - 1;
+    }
+    output(a[0] + a[9]);
+
+    s = 0;
+    i = 0;
+    while (i < 5) {
+        s = s + a[i] * i;
+        i = i + 1;
+    }
+    output(s);
+    output(i);
+
+    output(sum(0));
+    output(sum(7));
+    output(tail(0));
+    output(tail(2));
+    output(first(150));
+    output(first(151));
+}
@@ -0,0 +1,67 @@
+int size;
+
+int tick(int x)
+{
+    return x + 1;
+}
+
+int split(int n, int cold)
+{
+    int a;
+    int b;
+    int c;
+    int d;
+    int e;
+    int f;
+    int p;
+    int q;
+    int r;
+    int s;
+    int t;
+    int u;
+    int i;
+    int j;
+    a = 0;
+    b = 0;
+    c = 0;
+    d = 0;
+    e = 0;
+    f = 0;
+    p = 0;
+    q = 0;
+    r = 0;
+    s = 0;
+    t = 0;
+    u = 0;
+    i = 0;
+    while (i < cold) {
+        j = 0;
+        while (j < cold) {
+            a = a + 1;
+            b = b + 2;
+            c = c + 3;
+            d = d + 4;
+            e = e + 5;
+            f = f + 6;
+            j = tick(j);
+        }
+        i = i + 1;
+    }
+    i = 0;
+    while (i < n) {
+        p = p + 1;
+        q = q + 2;
+        r = r + 3;
+        s = s + 4;
+        t = t + 5;
+        u = u + 6;
+        i = tick(i);
+    }
+    return a + b + c + d + e + f + p + q + r + s + t + u;
+}
+
+void main(void)
+{
+    size = 100;
+    output(split(size, 0));
+}
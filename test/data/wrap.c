@@ -0,0 +1,82 @@
+int calls;
+int g[4];
+
+int fib(int n)
+{
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int walk(int a, int b, int c)
+{
+    calls = calls + 1;
+    if ((a + (b * c)) > 100) {
+        g[b - 9] = g[b - 9] + 1;
+        return a + (b * c);
+    }
+    if (a < 0) return 0 - a;
+    return walk(a + 1, b + 1, c);
+}
+
+int pick(int a, int b)
+{
+    int t;
+    if (a == b) {
+        a = a * 3;
+        return a + b;
+    } else {
+        t = fib(a);
+        b = b + t;
+    }
+    return a + b;
+}
+
+int bump(int x)
+{
+    calls = calls + x;
+    return x;
+}
+
+int other(int a, int b)
+{
+    if (a > b) {
+        bump(a);
+    } else return b - a;
+    return a;
+}
+
+int gcd(int a, int b)
+{
+    if (b == 0) return a;
+    return gcd(b, a - ((a / b) * b));
+}
+
+void tick(int x)
+{
+    if (x > 3) return;
+    g[x] = g[x] + fib(x);
+}
+
+void main(void)
+{
+    int i;
+    output(fib(15));
+    output(walk(3, 1, 10));
+    output(walk(0 - 5, 0, 0));
+    output(pick(4, 4));
+    output(pick(6, 2));
+    output(other(3, 9));
+    output(other(9, 3));
+    output(gcd(1071, 462));
+    i = 0;
+    while (i < 6) {
+        tick(i);
+        i = i + 1;
+    }
+    output(calls);
+    i = 0;
+    while (i < 4) {
+        output(g[i]);
+        i = i + 1;
+    }
+}
@@ -12,10 +12,15 @@ def process_stdout(output: bytes) -> bytes:
     return b"".join(lines[1:])
 
 
-def cmm(filename: str):
-    subprocess.run([CMM_PATH, 
-                    FILE_PREFIX + filename, 
-                    "-o", FILE_PREFIX + filename + FILE_SUFFIX])
+def cmm(filename: str, *flags: str) -> bytes:
+    """Compile a test program, returning what cmm wrote to stderr, such as
+    its --remarks."""
+    out = subprocess.run([CMM_PATH, 
+                          FILE_PREFIX + filename, 
+                          "-o", FILE_PREFIX + filename + FILE_SUFFIX,
+                          *flags],
+                          stderr=subprocess.PIPE)
+    return out.stderr
 
 
 def spim(filename: str) -> bytes:
@@ -16,13 +16,354 @@ def test_basic():
     
     cmm("recur.c")
     stdout = spim("recur.c")
-    assert process_stdout(stdout) == b"5"
+    assert process_stdout(stdout) == b"6"
 
     cmm("gcd.c")
     stdout = spim("gcd.c")
     assert process_stdout(stdout) == b"16"
 
 
+def test_dead_code():
+    for flag in ["-O0", "--passes=dce", "-O2"]:
+        cmm("dce.c", flag)
+        stdout = spim("dce.c")
+        assert process_stdout(stdout) == b"75111"
+
+    # The call in the dead store stays, but nothing unreachable does
+    cmm("dce.c", "--passes=dce")
+    with open("./test/data/dce.c.out") as asm:
+        code = asm.read()
+    assert "jal    bump" in code
+    for dead in ["111", "222", "333"]:
+        assert dead not in code
+
+
+def test_relops():
+    cmm("relops.c")
+    stdout = spim("relops.c")
+    assert process_stdout(stdout) == b"1910281"
+
+
+def test_inline():
+    cmm("inline.c")
+    stdout = spim("inline.c")
+    assert process_stdout(stdout) == b"5312"
+
+    cmm("inline.c", "--inline-threshold=0")
+    stdout = spim("inline.c")
+    assert process_stdout(stdout) == b"5312"
+
+
+def test_tail_calls():
+    remarks = cmm("tail.c", "--inline-threshold=0", "--remarks")
+    stdout = spim("tail.c")
+    assert process_stdout(stdout) == b"2000001372132"
+    # Self tail calls become loops before the tail call pass sees them
+    for func in [b"'down'", b"'count'", b"'swap'"]:
+        assert b"rewrote tail recursion in " + func in remarks
+    for call in [b"'down' in 'pick'", b"'count' in 'pick'"]:
+        assert b"tail call to " + call in remarks
+
+
+def test_accumulators():
+    remarks = cmm("accumulate.c", "--inline-threshold=0", "--remarks")
+    stdout = spim("accumulate.c")
+    assert process_stdout(stdout) == b"1250025000243"
+    assert b"recursion in 'sum' into a loop with a '+'" in remarks
+    assert b"recursion in 'power' into a loop with a '*'" in remarks
+    assert b"not rewriting recursion in 'tally'" in remarks
+
+
+def test_leaf_functions():
+    cmm("leaf.c", "--inline-threshold=0")
+    stdout = spim("leaf.c")
+    assert process_stdout(stdout) == b"22648714147"
+
+
+def test_arguments():
+    cmm("args.c", "--inline-threshold=0")
+    stdout = spim("args.c")
+    assert process_stdout(stdout) == b"6543214910204215434"
+
+
+def test_loop_invariants():
+    remarks = cmm("licm.c", "--inline-threshold=0", "--remarks")
+    stdout = spim("licm.c")
+    assert process_stdout(stdout) == b"10536015"
+
+    # Nothing moves past the call in calls, or the division in divides
+    hoisted = b"hoisted invariant expression out of loop in "
+    assert remarks.count(hoisted + b"'trace'") == 4
+    assert hoisted + b"'calls'" not in remarks
+    assert hoisted + b"'divides'" not in remarks
+
+
+def test_strength_reduction():
+    remarks = cmm("strength.c", "--inline-threshold=0", "--unroll=1",
+            "--remarks")
+    stdout = spim("strength.c")
+    assert process_stdout(stdout) == b"-10880912510"
+
+    # Both loops in fill are reduced, but only the first has its test
+    # rewritten
+    assert remarks.count(b"strength reduced 'a[i]' in 'fill'") == 2
+    assert remarks.count(b"strength reduced 'g[i]' in 'fill'") == 2
+    assert b"strength reduced 'g[i]' in 'sum'" in remarks
+    assert remarks.count(b"now compares pointers") == 1
+    assert b"loop test on 'i' in 'fill' now compares pointers" in remarks
+
+
+def test_loop_rotation():
+    remarks = cmm("rotate.c", "--inline-threshold=0", "--unroll=1",
+            "--remarks")
+    stdout = spim("rotate.c")
+    assert process_stdout(stdout) == b"04565"
+
+    # Every loop branches back from its bottom, and the outer loop in main
+    # starts with i = 3, so nothing branches around it
+    with open("./test/data/rotate.c.out") as asm:
+        code = asm.read()
+    for line in code.splitlines():
+        if line.startswith("while_body"):
+            assert f", {line[:-1]}\n" in code
+    assert code.count("while_end1") == 1
+    assert remarks.count(b"removed guard of loop in 'main'") == 1
+
+
+def test_loop_unrolling():
+    remarks = cmm("unroll.c", "--inline-threshold=0", "--remarks")
+    stdout = spim("unroll.c")
+    assert process_stdout(stdout) == b"18913758050212565314550-1"
+    assert b"unrolled loop on 'i' in 'tail' by 4" in remarks
+    assert b"unrolled loop on 'i' in 'first' by 4" in remarks
+    assert b"fully unrolled loop on 'i' in 'main' (5 iterations)" in remarks
+
+    remarks = cmm("unroll.c", "--unroll=3", "--unroll-limit=1000",
+            "--remarks")
+    stdout = spim("unroll.c")
+    assert process_stdout(stdout) == b"18913758050212565314550-1"
+    assert b"fully unrolled loop on 'i' in 'main' (64 iterations)" in remarks
+    assert b"unrolled loop on 'i' in 'main' by 3" in remarks
+
+
+def test_common_subexpressions():
+    remarks = cmm("cse.c", "--remarks")
+    assert b"computed a common subexpression once" in remarks
+    with open("./test/data/cse.c.in") as stdin:
+        out = subprocess.run(["spim", "-file", "./test/data/cse.c.out"],
+                stdin=stdin,
+                stdout=subprocess.PIPE)
+
+    assert process_stdout(out.stdout) == b"834898108"
+
+
+def test_constant_propagation():
+    cmm("sccp.c")
+    stdout = spim("sccp.c")
+    assert process_stdout(stdout) == b"31010-27124"
+
+    # Every product is folded, the overflowing one wrapping as mul would
+    with open("./test/data/sccp.c.out") as asm:
+        assert "mul" not in asm.read()
+
+
+def test_compile_time_calls():
+    cmm("pure.c")
+    stdout = spim("pure.c")
+    assert process_stdout(stdout) == b"1206045301010001932053504"
+
+    cmm("pure.c", "--inline-threshold=0")
+    stdout = spim("pure.c")
+    assert process_stdout(stdout) == b"1206045301010001932053504"
+
+
+def test_small_data():
+    cmm("globals.c")
+    stdout = spim("globals.c")
+    assert process_stdout(stdout) == b"20247011401330361"
+
+    cmm("globals.c", "--small-data=0")
+    stdout = spim("globals.c")
+    assert process_stdout(stdout) == b"20247011401330361"
+
+
+def test_constant_operands():
+    cmm("muldiv.c")
+    stdout = spim("muldiv.c")
+    assert process_stdout(stdout) == \
+        b"-5-26-620-1920300-2-13-341-1056165000-62-1923011-2217672-10542" \
+        b"-54961536-240"
+
+    # Only the divisions by 7 and -3 need a multiply, by a magic number
+    with open("./test/data/muldiv.c.out") as asm:
+        code = asm.read()
+    assert "div    " not in code
+    assert "mul    " not in code
+    assert code.count("mult   ") == 2
+
+
+def test_immediate_operands():
+    cmm("immediate.c")
+    stdout = spim("immediate.c")
+    assert process_stdout(stdout) == \
+        b"2710001-65536411111-12210101-21810101-327582210101-32757" \
+        b"1900001-65537"
+
+    # Sums keep trapping on overflow, so take addi rather than addiu
+    with open("./test/data/immediate.c.out") as asm:
+        code = asm.read()
+    assert "addi   " in code
+    assert "slti   " in code
+
+
+def test_profile():
+    cmm("profile.c", "--profile-generate")
+    stdout = spim("profile.c")
+    assert process_stdout(stdout) == b"2380\n#profile\n40\n0\n1\n40\n0\n"
+
+    with open("./test/data/profile.c.prof", "wb") as profile:
+        profile.write(stdout)
+    remarks = cmm("profile.c", "--profile-use=./test/data/profile.c.prof",
+            "--remarks")
+    stdout = spim("profile.c")
+    assert process_stdout(stdout) == b"2380"
+
+    # The hot loop is unrolled, which its size alone would not allow
+    assert b"(cost 1, threshold 64)" in remarks
+    assert b"unrolled loop on 'i' in 'main' by 4" in remarks
+    assert b"not unrolling" in cmm("profile.c", "--remarks")
+
+
+def test_block_layout():
+    moved = b"moved an arm of an if in 'main' after the function's exit"
+
+    remarks = cmm("layout.c", "--remarks")
+    stdout = spim("layout.c")
+    assert process_stdout(stdout) == b"2906010062120"
+    assert remarks.count(moved) == 4
+
+    cmm("layout.c", "--profile-generate")
+    stdout = spim("layout.c")
+    with open("./test/data/layout.c.prof", "wb") as profile:
+        profile.write(stdout)
+    remarks = cmm("layout.c", "--profile-use=./test/data/layout.c.prof",
+            "--remarks")
+    stdout = spim("layout.c")
+    assert process_stdout(stdout) == b"2906010062120"
+    # The profile also moves an arm that never ran
+    assert remarks.count(moved) == 5
+
+
+def test_frame_layout():
+    for flag in ["-O0", "-O2", "--passes=tail"]:
+        cmm("frames.c", flag)
+        stdout = spim("frames.c")
+        assert process_stdout(stdout) == \
+            b"-196123450376599801482111108023457104321110000"
+
+
+def test_omit_frame_pointer():
+    for flag in ["-O0", "-O2"]:
+        cmm("frames.c", flag, "-fomit-frame-pointer")
+        stdout = spim("frames.c")
+        assert process_stdout(stdout) == \
+            b"-196123450376599801482111108023457104321110000"
+
+
+def test_shrink_wrapping():
+    for flag in ["-O0", "-O2", "-fomit-frame-pointer"]:
+        cmm("wrap.c", flag)
+        stdout = spim("wrap.c")
+        assert process_stdout(stdout) == b"610101516166921191112"
+
+
+def test_interprocedural_registers():
+    for flag in ["-O0", "-O2", "-fomit-frame-pointer", "-fwhole-program"]:
+        remarks = cmm("ipra.c", flag, "--remarks")
+        stdout = spim("ipra.c")
+        assert process_stdout(stdout) == b"85491844590260"
+
+        # down calls itself, so keeps nothing in registers
+        kept = b"kept %d variable(s) of '%s' in registers"
+        if flag == "-O0":
+            assert kept % (4, b"mix") in remarks
+            assert kept % (3, b"chain") in remarks
+        else:
+            assert kept % (3, b"wide") in remarks
+            assert kept % (3, b"main") in remarks
+        assert b"of 'down' in registers" not in remarks
+
+        # Only -fwhole-program leaves results in $a0
+        with open("./test/data/ipra.c.out") as asm:
+            returns_v0 = "move   $v0, $a0" in asm.read()
+        assert returns_v0 == (flag != "-fwhole-program")
+
+
+def test_profile_weighted_registers():
+    def frame_accesses():
+        with open("./test/data/weights.c.out") as asm:
+            code = asm.read()
+        hot_loop = code[code.index("while_body2:"):code.index("while_end2:")]
+        return hot_loop.count("($fp)")
+
+    # Without a profile, the variables of the more deeply nested loop get
+    # the registers, though it never runs
+    flags = ["--inline-threshold=0", "--unroll=1"]
+    cmm("weights.c", *flags)
+    stdout = spim("weights.c")
+    assert process_stdout(stdout) == b"2100"
+    cold = frame_accesses()
+
+    cmm("weights.c", *flags, "--profile-generate")
+    stdout = spim("weights.c")
+    with open("./test/data/weights.c.prof", "wb") as profile:
+        profile.write(stdout)
+    cmm("weights.c", *flags, "--profile-use=./test/data/weights.c.prof")
+    stdout = spim("weights.c")
+    assert process_stdout(stdout) == b"2100"
+
+    # Only n is left in the frame
+    assert frame_accesses() == 1
+    assert cold > 1
+
+
+def test_optimisation_levels():
+    # Each level runs the passes it names, and only those
+    for flag, propagates, inlines in [("-O0", False, False),
+                                      ("-O1", True, False),
+                                      ("-O2", True, True),
+                                      ("--passes=inline,cse,inline,dce",
+                                       False, True)]:
+        remarks = cmm("sccp.c", flag, "--remarks")
+        stdout = spim("sccp.c")
+        assert process_stdout(stdout) == b"31010-27124"
+        assert (b"propagated" in remarks) == propagates
+        assert (b"inlined 'sum'" in remarks) == inlines
+
+
+def test_delay_slots():
+    for filename, expected in [("relops.c", b"1910281"), ("gcd.c", b"16"),
+                               ("sccp.c", b"31010-27124")]:
+        cmm(filename, "--delay-slots")
+        out = subprocess.run(["spim", "-delayed_branches", "-delayed_loads",
+                              "-file", "./test/data/" + filename + ".out"],
+                stdout=subprocess.PIPE)
+
+        assert process_stdout(out.stdout) == expected
+
+    # The real div doesn't trap on a zero divisor, so a teq checks first
+    cmm("divide.c", "--delay-slots")
+    with open("./test/data/divide.c.in") as stdin:
+        out = subprocess.run(["spim", "-delayed_branches", "-delayed_loads",
+                              "-file", "./test/data/divide.c.out"],
+                stdin=stdin,
+                stdout=subprocess.PIPE)
+
+    assert process_stdout(out.stdout) == b"140"
+    with open("./test/data/divide.c.out") as asm:
+        assert asm.read().count("teq    ") == 2
+
+
 def test_io():
     cmm("io.c")
     with open("./test/data/io.c.in") as stdin: